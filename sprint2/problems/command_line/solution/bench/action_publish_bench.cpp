@@ -0,0 +1,89 @@
+// Микробенчмарк публикации действий игроков: снимок после каждого действия в сравнении
+// с одним снимком на ход strand'а (GameSession::MarkDogMotion и PublishDogMotion).
+// После каждой публикации приходит запрос /api/v1/game/state, и тело ответа строится
+// заново, так как у нового снимка ещё нет готового тела
+#include "../src/game_serializer.h"
+#include "../src/model.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace std::literals;
+
+namespace {
+
+struct TickCost {
+    double us = 0;
+    double snapshots = 0;
+    double serializations = 0;
+};
+
+// Сессия из dogs псов; за тик каждый пес меняет направление. Действия обрабатываются
+// по actions_per_turn за ход strand'а, после хода публикуется один снимок
+TickCost MeasureTick(size_t dogs, size_t actions_per_turn, int ticks) {
+    model::Map map{model::Map::Id{"bench"s}, "bench"s};
+    map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 1000});
+    model::GameSession session{model::GameSession::Id{"bench"s}, map};
+    for (size_t i = 0; i < dogs; ++i) {
+        session.AddDog("dog"s + std::to_string(i), session.GetMap().GetRoads().front(), model::Speed{0, 0});
+    }
+    session.PublishSnapshot();
+
+    size_t snapshots = 0;
+    size_t serializations = 0;
+    size_t bytes = 0;
+    const auto poll = [&] {
+        const auto snapshot = session.GetSnapshot();
+        bytes += snapshot->state_body[0].Get([&] {
+            ++serializations;
+            return game_serializer::SerializeState(*snapshot);
+        })->size();
+    };
+    const auto publish = [&] {
+        const auto before = session.GetSnapshot();
+        session.PublishDogMotion();
+        snapshots += session.GetSnapshot() != before;
+        poll();
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        const bool west = tick % 2;
+        for (size_t i = 0; i < dogs; ++i) {
+            auto& dog = *session.GetDogs()[i];
+            dog.SetDirection(west ? model::Direction::WEST : model::Direction::EAST);
+            dog.SetSpeed(model::Speed{west ? -1.0 : 1.0, 0});
+            session.MarkDogMotion(dog.GetId());
+            if ((i + 1) % actions_per_turn == 0) {
+                publish();
+            }
+        }
+        publish();
+        session.Tick(0.001);
+        session.PublishSnapshot();
+        ++snapshots;
+        poll();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (bytes == 0) {
+        std::cerr << "empty state"sv << std::endl;
+    }
+    return {std::chrono::duration<double, std::micro>(elapsed).count() / ticks,
+            static_cast<double>(snapshots) / ticks, static_cast<double>(serializations) / ticks};
+}
+
+}  // namespace
+
+int main() {
+    constexpr size_t dogs = 1'000;
+    constexpr int ticks = 50;
+    std::cout << "dogs: "sv << dogs << ", actions per tick: "sv << dogs << std::endl;
+    // 1 действие за ход — так снимок публиковался после каждого действия
+    for (size_t actions_per_turn : {1, 16, 1'000}) {
+        const auto cost = MeasureTick(dogs, actions_per_turn, ticks);
+        std::cout << "actions/turn: "sv << actions_per_turn
+                  << "\t"sv << cost.us << " us/tick"sv
+                  << "\t"sv << cost.snapshots << " snapshots/tick"sv
+                  << "\t"sv << cost.serializations << " state serializations/tick"sv << std::endl;
+    }
+}
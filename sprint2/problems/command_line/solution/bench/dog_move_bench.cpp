@@ -0,0 +1,89 @@
+// Микробенчмарк перемещения псов: DogStore::Move (AVX2) и DogStore::MoveScalar
+// в сравнении с обходом псов, размещённых в куче по отдельности
+#include "../src/model.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+
+using namespace std::literals;
+
+namespace {
+
+// Так псы хранились до появления DogStore: каждый в своём блоке памяти
+struct HeapDog {
+    model::Coordinate coordinate;
+    model::Speed speed;
+    model::Coordinate min;
+    model::Coordinate max;
+};
+
+template <typename Fn>
+double MeasureUpdatesPerMs(size_t dogs, int ticks, Fn&& tick) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ticks; ++i) {
+        tick();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return dogs * ticks / std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+void RunBench(size_t dogs) {
+    // Общее число обновлений примерно одинаково для всех размеров сессии
+    const int ticks = static_cast<int>(50'000'000 / dogs);
+    constexpr double time_delta = 0.001;
+
+    std::mt19937 gen{42};
+    std::uniform_real_distribution<double> coord(0, 1000);
+    std::uniform_real_distribution<double> speed(-3, 3);
+
+    model::DogStore store;
+    std::vector<std::shared_ptr<HeapDog>> heap_dogs;
+    heap_dogs.reserve(dogs);
+    for (size_t i = 0; i < dogs; ++i) {
+        const model::Coordinate c{coord(gen), coord(gen)};
+        // Половина псов бежит по горизонтали, половина по вертикали
+        const model::Speed v = i % 2 ? model::Speed{speed(gen), 0} : model::Speed{0, speed(gen)};
+        const model::Coordinate min = i % 2 ? model::Coordinate{c.x - 100, c.y} : model::Coordinate{c.x, c.y - 100};
+        const model::Coordinate max = i % 2 ? model::Coordinate{c.x + 100, c.y} : model::Coordinate{c.x, c.y + 100};
+        const auto index = store.Add("dog"s, c, v, model::Direction::NORTH);
+        store.SetBounds(index, min, max);
+        heap_dogs.push_back(std::make_shared<HeapDog>(HeapDog{c, v, min, max}));
+    }
+    // Перемешиваем указатели, как если бы псы создавались вперемешку с другими объектами
+    std::shuffle(heap_dogs.begin(), heap_dogs.end(), gen);
+
+    model::DogStore scalar_store = store;
+    const double simd = MeasureUpdatesPerMs(dogs, ticks, [&] {
+        store.Move(time_delta);
+    });
+    const double scalar = MeasureUpdatesPerMs(dogs, ticks, [&] {
+        scalar_store.MoveScalar(time_delta);
+    });
+    const double heap = MeasureUpdatesPerMs(dogs, ticks, [&] {
+        for (auto& dog : heap_dogs) {
+            auto& d = *dog;
+            const double new_x = d.coordinate.x + d.speed.vx * time_delta;
+            const double new_y = d.coordinate.y + d.speed.vy * time_delta;
+            d.coordinate.x = std::min(std::max(new_x, d.min.x), d.max.x);
+            d.coordinate.y = std::min(std::max(new_y, d.min.y), d.max.y);
+            if (d.coordinate.x != new_x || d.coordinate.y != new_y) {
+                d.speed = {0, 0};
+            }
+        }
+    });
+
+    std::cout << "dogs: "sv << dogs << ", ticks: "sv << ticks << std::endl
+              << "DogStore::Move:       "sv << simd << " dog-updates/ms"sv << std::endl
+              << "DogStore::MoveScalar: "sv << scalar << " dog-updates/ms"sv << std::endl
+              << "heap dogs:            "sv << heap << " dog-updates/ms"sv << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    for (size_t dogs : {1'000, 10'000, 100'000, 1'000'000}) {
+        RunBench(dogs);
+    }
+}
@@ -0,0 +1,123 @@
+// Запросов в секунду на одно соединение через loopback: новое соединение на каждый запрос
+// (так работали клиенты, пока сервер закрывал соединение после ответа), последовательные
+// запросы по keep-alive соединению и конвейер (pipelining) из нескольких запросов
+#include "../src/http_server.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace std::literals;
+namespace net = boost::asio;
+namespace http = boost::beast::http;
+using tcp = net::ip::tcp;
+
+namespace {
+
+using Request = http::request<http::string_body>;
+using Response = http::response<http::string_body>;
+
+Request MakeRequest(bool keep_alive) {
+    Request req{http::verb::get, "/api/v1/game/state", 11};
+    req.set(http::field::host, "127.0.0.1");
+    req.keep_alive(keep_alive);
+    return req;
+}
+
+// Обработчик отвечает из другого потока io_context, как игровые запросы из strand'а сессии
+struct EchoHandler {
+    net::io_context* ioc;
+
+    template <typename Req, typename Send>
+    void operator()(Req&& req, Send&& send) const {
+        net::post(*ioc, [version = req.version(), send = std::forward<Send>(send)]() mutable {
+            Response res{http::status::ok, version};
+            res.set(http::field::content_type, "application/json");
+            res.body() = R"({"players":{}})";
+            send(std::move(res));
+        });
+    }
+};
+
+template <typename Fn>
+void Measure(std::string_view name, int requests, Fn&& run) {
+    const auto start = std::chrono::steady_clock::now();
+    run(requests);
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << "\t"sv << static_cast<long>(requests / elapsed) << " requests/s"sv << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    net::io_context server_ioc;
+    const tcp::endpoint endpoint{net::ip::make_address("127.0.0.1"), 0};
+    // Порт выбирает система: узнаём его у пробного сокета и сразу освобождаем
+    tcp::acceptor probe{server_ioc, endpoint};
+    const tcp::endpoint server_endpoint = probe.local_endpoint();
+    probe.close();
+    http_server::ServeHttp(server_ioc, server_endpoint, EchoHandler{&server_ioc});
+    std::thread server_threads[2];
+    for (auto& thread : server_threads) {
+        thread = std::thread{[&server_ioc] {
+            server_ioc.run();
+        }};
+    }
+
+    net::io_context client_ioc;
+    boost::beast::flat_buffer buffer;
+
+    Measure("connection per request"sv, 5'000, [&](int requests) {
+        const auto req = MakeRequest(false);
+        for (int i = 0; i < requests; ++i) {
+            tcp::socket socket{client_ioc};
+            socket.connect(server_endpoint);
+            http::write(socket, req);
+            Response res;
+            http::read(socket, buffer, res);
+            buffer.clear();
+        }
+    });
+
+    Measure("keep-alive            "sv, 50'000, [&](int requests) {
+        tcp::socket socket{client_ioc};
+        socket.connect(server_endpoint);
+        const auto req = MakeRequest(true);
+        for (int i = 0; i < requests; ++i) {
+            http::write(socket, req);
+            Response res;
+            http::read(socket, buffer, res);
+        }
+    });
+
+    for (int depth : {4, 16}) {
+        Measure("pipelined, depth "s + std::to_string(depth) + "   ", 100'000, [&](int requests) {
+            tcp::socket socket{client_ioc};
+            socket.connect(server_endpoint);
+            // Пачка запросов уходит одной записью, ответы читаются после неё
+            std::string batch;
+            for (int i = 0; i < depth; ++i) {
+                std::ostringstream out;
+                out << MakeRequest(true);
+                batch += out.str();
+            }
+            for (int sent = 0; sent < requests; sent += depth) {
+                net::write(socket, net::buffer(batch));
+                for (int i = 0; i < depth; ++i) {
+                    Response res;
+                    http::read(socket, buffer, res);
+                }
+            }
+        });
+    }
+
+    server_ioc.stop();
+    for (auto& thread : server_threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,126 @@
+// Пропускная способность сервера через loopback при высокой частоте подключений:
+// один общий io_context на N потоках с одним прослушивающим сокетом (как по умолчанию)
+// против N однопоточных io_context, у каждого из которых свой сокет с SO_REUSEPORT.
+// Запуск: io_shards_bench [число потоков сервера] [число клиентов]
+#include "../src/http_server.h"
+#include "../src/io_shards.h"
+
+#include <boost/asio/io_context.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+namespace net = boost::asio;
+namespace http = boost::beast::http;
+using tcp = net::ip::tcp;
+
+namespace {
+
+using Request = http::request<http::string_body>;
+using Response = http::response<http::string_body>;
+
+constexpr auto MEASURE_TIME = 2s;
+
+// Отвечает сразу, как на запросы карт и статических файлов
+struct EchoHandler {
+    template <typename Req, typename Send>
+    void operator()(Req&& req, Send&& send) const {
+        Response res{http::status::ok, req.version()};
+        res.set(http::field::content_type, "application/json");
+        res.body() = R"({"players":{}})";
+        send(std::move(res));
+    }
+};
+
+tcp::endpoint PickEndpoint() {
+    net::io_context ioc;
+    tcp::acceptor probe{ioc, {net::ip::make_address("127.0.0.1"), 0}};
+    return probe.local_endpoint();
+}
+
+// Клиенты подключаются заново на каждый запрос (keep_alive == false)
+// или шлют запросы подряд по одному соединению. Возвращает запросов в секунду
+double RunClients(const tcp::endpoint& endpoint, unsigned clients, bool keep_alive) {
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> total{0};
+    std::vector<std::thread> threads;
+    for (unsigned c = 0; c < clients; ++c) {
+        threads.emplace_back([&] {
+            net::io_context ioc;
+            boost::beast::flat_buffer buffer;
+            Request req{http::verb::get, "/api/v1/maps", 11};
+            req.set(http::field::host, "127.0.0.1");
+            req.keep_alive(keep_alive);
+            uint64_t done = 0;
+            std::optional<tcp::socket> socket;
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (!socket) {
+                    socket.emplace(ioc);
+                    socket->connect(endpoint);
+                }
+                http::write(*socket, req);
+                Response res;
+                http::read(*socket, buffer, res);
+                ++done;
+                if (!keep_alive) {
+                    socket.reset();
+                    buffer.clear();
+                }
+            }
+            total += done;
+        });
+    }
+    std::this_thread::sleep_for(MEASURE_TIME);
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return total / std::chrono::duration<double>(MEASURE_TIME).count();
+}
+
+void Report(std::string_view model, const tcp::endpoint& endpoint, unsigned clients) {
+    std::cout << model << "\tnew connection per request: "sv << static_cast<long>(RunClients(endpoint, clients, false))
+              << " requests/s\tkeep-alive: "sv << static_cast<long>(RunClients(endpoint, clients, true))
+              << " requests/s"sv << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    const unsigned server_threads = argc > 1 ? std::stoul(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+    const unsigned clients = argc > 2 ? std::stoul(argv[2]) : server_threads * 4;
+    std::cout << "server threads: "sv << server_threads << "\tclients: "sv << clients << std::endl;
+
+    {
+        net::io_context ioc(static_cast<int>(server_threads));
+        const auto endpoint = PickEndpoint();
+        http_server::ServeHttp(ioc, endpoint, EchoHandler{});
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < server_threads; ++i) {
+            threads.emplace_back([&ioc] {
+                ioc.run();
+            });
+        }
+        Report("shared io_context"sv, endpoint, clients);
+        ioc.stop();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    {
+        io_shards::IoShards shards{server_threads};
+        const auto endpoint = PickEndpoint();
+        for (size_t i = 0; i < shards.Size(); ++i) {
+            http_server::ServeHttpReusePort(shards.GetShard(i), endpoint, EchoHandler{});
+        }
+        shards.Run();
+        Report("io shards        "sv, endpoint, clients);
+    }
+}
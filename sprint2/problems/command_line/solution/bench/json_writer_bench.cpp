@@ -0,0 +1,101 @@
+// Микробенчмарк сериализации состояния игры: JsonWriter против дерева boost::json
+// с последующим json::serialize. Считаются время и число выделений памяти на ответ
+#include "../src/game_serializer.h"
+#include "../src/model.h"
+
+#include <boost/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+
+using namespace std::literals;
+namespace json = boost::json;
+
+namespace {
+std::atomic<size_t> allocations{0};
+}  // namespace
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+// Так ответ /api/v1/game/state строился до появления JsonWriter
+std::string SerializeStateDom(const model::SessionSnapshot& snapshot) {
+    json::object players;
+    for (size_t id = 0; id < snapshot.dogs.size(); ++id) {
+        const auto& dog = snapshot.dogs[id];
+        players[std::to_string(id)] = json::object{
+            {"pos", json::array{dog.coordinate.x, dog.coordinate.y}},
+            {"speed", json::array{dog.speed.vx, dog.speed.vy}},
+            {"dir", model::DirectionToString(dog.direction)}};
+    }
+    json::object response;
+    response["players"] = players;
+    return json::serialize(response);
+}
+
+// Снимок нельзя перемещать (в нём лежат once_flag кэшированных тел), поэтому он создаётся в куче
+std::unique_ptr<model::SessionSnapshot> MakeSnapshot(size_t dogs) {
+    std::mt19937 gen{42};
+    std::uniform_real_distribution<double> coord(0, 100);
+    std::uniform_real_distribution<double> speed(-3, 3);
+    auto snapshot = std::make_unique<model::SessionSnapshot>();
+    auto names = std::make_shared<std::vector<std::string>>();
+    for (size_t i = 0; i < dogs; ++i) {
+        names->push_back("dog"s + std::to_string(i));
+        snapshot->dogs.push_back({{coord(gen), coord(gen)}, {speed(gen), speed(gen)}, model::Direction::NORTH});
+    }
+    snapshot->names = std::move(names);
+    return snapshot;
+}
+
+template <typename Fn>
+void Measure(std::string_view name, const model::SessionSnapshot& snapshot, int iterations, Fn&& serialize) {
+    size_t bytes = 0;
+    const size_t allocations_before = allocations.load();
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        bytes += serialize(snapshot).size();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const size_t allocated = allocations.load() - allocations_before;
+    std::cout << name << "\tdogs: "sv << snapshot.dogs.size()
+              << "\t"sv << std::chrono::duration<double, std::nano>(elapsed).count() / iterations << " ns/response"sv
+              << "\t"sv << static_cast<double>(allocated) / iterations << " allocations/response"sv
+              << "\t"sv << bytes / iterations << " bytes"sv << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    for (size_t dogs : {10, 1'000, 10'000}) {
+        const auto snapshot = MakeSnapshot(dogs);
+        const int iterations = static_cast<int>(2'000'000 / dogs);
+        Measure("dom   "sv, *snapshot, iterations, SerializeStateDom);
+        Measure("writer"sv, *snapshot, iterations, [](const model::SessionSnapshot& snapshot) {
+            return game_serializer::SerializeState(snapshot);
+        });
+        // Координаты, округлённые до сотых (--state-coord-decimals 2)
+        Measure("fixed2"sv, *snapshot, iterations, [](const model::SessionSnapshot& snapshot) {
+            return game_serializer::SerializeState(snapshot, 2);
+        });
+    }
+}
@@ -0,0 +1,82 @@
+// Микробенчмарк поиска дороги по координате: сетка Map::FindRoad против линейного перебора
+#include "../src/model.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+using namespace std::literals;
+
+namespace {
+
+// Линейный перебор дорог — так работал Dog::GetCurrentRoad до появления индекса
+const model::Road* FindRoadLinear(const model::Map::Roads& roads, const model::Coordinate& c) {
+    for (const auto& road : roads) {
+        const double min_x = std::min(road.GetStart().x, road.GetEnd().x) - model::ROAD_HALF_WIDTH;
+        const double max_x = std::max(road.GetStart().x, road.GetEnd().x) + model::ROAD_HALF_WIDTH;
+        const double min_y = std::min(road.GetStart().y, road.GetEnd().y) - model::ROAD_HALF_WIDTH;
+        const double max_y = std::max(road.GetStart().y, road.GetEnd().y) + model::ROAD_HALF_WIDTH;
+        if (c.x >= min_x && c.x <= max_x && c.y >= min_y && c.y <= max_y) {
+            return &road;
+        }
+    }
+    return nullptr;
+}
+
+// Карта-решётка side x side кварталов, каждая улица разбита на отрезки длиной block
+model::Map MakeGridMap(int side, int block) {
+    model::Map map{model::Map::Id{"bench"s}, "bench"s};
+    for (int i = 0; i <= side; ++i) {
+        for (int j = 0; j < side; ++j) {
+            map.AddRoad({model::Road::HORIZONTAL, {j * block, i * block}, (j + 1) * block});
+            map.AddRoad({model::Road::VERTICAL, {i * block, j * block}, (j + 1) * block});
+        }
+    }
+    return map;
+}
+
+template <typename Fn>
+double MeasureNsPerLookup(const std::vector<model::Coordinate>& points, Fn&& find) {
+    const auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (const auto& point : points) {
+        found += find(point) != nullptr;
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (found == 0) {
+        std::cerr << "no roads found"sv << std::endl;
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() / points.size();
+}
+
+}  // namespace
+
+int main() {
+    constexpr int block = 10;
+    for (int side : {10, 50, 100, 200}) {
+        const model::Map map = MakeGridMap(side, block);
+
+        // Случайные точки на дорогах карты
+        std::mt19937 gen{42};
+        std::uniform_int_distribution<int> line(0, side);
+        std::uniform_real_distribution<double> along(0, side * block);
+        std::uniform_real_distribution<double> across(-model::ROAD_HALF_WIDTH, model::ROAD_HALF_WIDTH);
+        std::vector<model::Coordinate> points;
+        constexpr size_t lookups = 100'000;
+        points.reserve(lookups);
+        for (size_t i = 0; i < lookups; ++i) {
+            const double on_line = line(gen) * block + across(gen);
+            points.push_back(i % 2 ? model::Coordinate{along(gen), on_line} : model::Coordinate{on_line, along(gen)});
+        }
+
+        const double indexed = MeasureNsPerLookup(points, [&map](const auto& p) {
+            return map.FindRoad(p);
+        });
+        const double linear = MeasureNsPerLookup(points, [&map](const auto& p) {
+            return FindRoadLinear(map.GetRoads(), p);
+        });
+        std::cout << "roads: "sv << map.GetRoads().size()
+                  << "\tindex: "sv << indexed << " ns/lookup"sv
+                  << "\tlinear: "sv << linear << " ns/lookup"sv << std::endl;
+    }
+}
@@ -0,0 +1,174 @@
+// Время выбора маршрута на запрос: прежняя цепочка сравнений target() с каждым путём
+// против дерева маршрутов (router::Router) на путях API сервера, а также линейный
+// перебор шаблонов против дерева на синтетических таблицах из 10, 100 и 1000 маршрутов
+#include "../src/router.h"
+
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+// Те же пути, что в API_ROUTES из request_handler.h; значение — номер эндпоинта
+constexpr std::array API_ROUTES{
+    router::Route<int>{"/api/v1/maps", 1},
+    router::Route<int>{"/api/v1/maps/{id}", 2},
+    router::Route<int>{"/api/v1/game/join", 3},
+    router::Route<int>{"/api/v1/game/players", 4},
+    router::Route<int>{"/api/v1/game/state", 5},
+    router::Route<int>{"/api/v1/game/player/actions", 6},
+    router::Route<int>{"/api/v1/game/player/action", 7},
+    router::Route<int>{"/api/v1/metrics", 8},
+    router::Route<int>{"/api/v1/game/tick", 9},
+};
+
+constexpr router::Router<int, router::CountNodes(API_ROUTES)> API_ROUTER{API_ROUTES};
+
+// Так RequestHandler выбирал обработчик до появления дерева маршрутов
+int FindEndpointChain(std::string_view target) {
+    if (target == "/api/v1/maps"sv) {
+        return 1;
+    } else if (target.starts_with("/api/v1/maps/"sv)) {
+        return 2;
+    } else if (target == "/api/v1/game/join"sv) {
+        return 3;
+    } else if (target == "/api/v1/game/players"sv) {
+        return 4;
+    } else if (target.substr(0, target.find('?')) == "/api/v1/game/state"sv) {
+        return 5;
+    } else if (target == "/api/v1/game/player/actions"sv) {
+        return 6;
+    } else if (target == "/api/v1/game/player/action"sv) {
+        return 7;
+    } else if (target == "/api/v1/metrics"sv) {
+        return 8;
+    } else if (target == "/api/v1/game/tick"sv) {
+        return 9;
+    }
+    return 0;
+}
+
+// Сравнение пути с шаблоном по сегментам, как в простом маршрутизаторе со списком шаблонов
+bool MatchPattern(std::string_view pattern, std::string_view path) {
+    for (;;) {
+        pattern.remove_prefix(1);
+        path.remove_prefix(1);
+        const std::string_view pattern_segment = pattern.substr(0, pattern.find('/'));
+        const std::string_view path_segment = path.substr(0, path.find('/'));
+        const bool is_param = pattern_segment.size() >= 2 && pattern_segment.front() == '{';
+        if (is_param ? path_segment.empty() : pattern_segment != path_segment) {
+            return false;
+        }
+        pattern.remove_prefix(pattern_segment.size());
+        path.remove_prefix(path_segment.size());
+        if (pattern.empty() || path.empty()) {
+            return pattern.empty() && path.empty();
+        }
+    }
+}
+
+template <typename Fn>
+double MeasureNsPerLookup(const std::vector<std::string>& paths, int expected_sum, Fn&& find) {
+    constexpr int rounds = 5;
+    const auto start = std::chrono::steady_clock::now();
+    long sum = 0;
+    for (int round = 0; round < rounds; ++round) {
+        for (const auto& path : paths) {
+            sum += find(std::string_view{path});
+        }
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (sum != static_cast<long>(expected_sum) * rounds) {
+        std::cerr << "route mismatch"sv << std::endl;
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (paths.size() * rounds);
+}
+
+// Пути запросов вперемешку: случайный маршрут, параметр — случайное число
+template <typename MakePath>
+std::vector<std::string> MakePaths(size_t route_count, MakePath&& make_path, int& expected_sum) {
+    constexpr size_t lookups = 100'000;
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<size_t> pick(0, route_count - 1);
+    std::vector<std::string> paths;
+    paths.reserve(lookups);
+    expected_sum = 0;
+    for (size_t i = 0; i < lookups; ++i) {
+        const size_t route = pick(gen);
+        paths.push_back(make_path(route, std::to_string(gen())));
+        expected_sum += static_cast<int>(route) + 1;
+    }
+    return paths;
+}
+
+void MeasureApi() {
+    constexpr std::array api_paths{
+        "/api/v1/maps"sv, "/api/v1/maps/"sv, "/api/v1/game/join"sv, "/api/v1/game/players"sv, "/api/v1/game/state"sv,
+        "/api/v1/game/player/actions"sv, "/api/v1/game/player/action"sv, "/api/v1/metrics"sv, "/api/v1/game/tick"sv,
+    };
+    int expected_sum = 0;
+    const auto paths = MakePaths(api_paths.size(), [&](size_t route, const std::string& param) {
+        return route == 1 ? std::string{api_paths[route]} + "map" + param : std::string{api_paths[route]};
+    }, expected_sum);
+
+    std::cout << "API routes ("sv << API_ROUTES.size() << ")\tif/else chain "sv
+              << MeasureNsPerLookup(paths, expected_sum, FindEndpointChain) << " ns\trouter "sv
+              << MeasureNsPerLookup(paths, expected_sum, [](std::string_view path) {
+                     const auto match = API_ROUTER.Find(path);
+                     return match ? *match->value : 0;
+                 })
+              << " ns"sv << std::endl;
+}
+
+// Маршруты вида /api/v1/resource<N>/{id}/items: число сегментов как у путей API,
+// и у каждого маршрута свой литерал на третьем уровне
+void MeasureSynthetic(size_t route_count) {
+    constexpr size_t max_nodes = 4'096;
+    std::vector<std::string> patterns;
+    for (size_t i = 0; i < route_count; ++i) {
+        patterns.push_back("/api/v1/resource"s + std::to_string(i) + "/{id}/items");
+    }
+    std::vector<router::Route<int>> routes;
+    for (size_t i = 0; i < route_count; ++i) {
+        routes.push_back({patterns[i], static_cast<int>(i) + 1});
+    }
+    // Дерево на max_nodes узлов не помещается на стек
+    const auto tree = std::make_unique<router::Router<int, max_nodes>>(routes);
+
+    int expected_sum = 0;
+    const auto paths = MakePaths(route_count, [](size_t route, const std::string& param) {
+        return "/api/v1/resource"s + std::to_string(route) + "/" + param + "/items";
+    }, expected_sum);
+
+    std::cout << route_count << " routes\tlinear scan "sv
+              << MeasureNsPerLookup(paths, expected_sum, [&routes](std::string_view path) {
+                     for (const auto& route : routes) {
+                         if (MatchPattern(route.pattern, path)) {
+                             return route.value;
+                         }
+                     }
+                     return 0;
+                 })
+              << " ns\trouter "sv
+              << MeasureNsPerLookup(paths, expected_sum, [&tree](std::string_view path) {
+                     const auto match = tree->Find(path);
+                     return match ? *match->value : 0;
+                 })
+              << " ns"sv << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    MeasureApi();
+    for (size_t route_count : {10, 100, 1'000}) {
+        MeasureSynthetic(route_count);
+    }
+}
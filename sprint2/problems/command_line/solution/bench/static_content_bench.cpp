@@ -0,0 +1,94 @@
+// Время подготовки ответа со статическим файлом: прежний путь через диск (два вызова
+// weakly_canonical, открытие и чтение файла) против поиска в StaticCache, а также число
+// байт, которое клиент получает за все файлы каталога в каждом из кодирований.
+// Запуск: static_content_bench [каталог статики]
+#include "../src/static_content.h"
+
+#include <boost/beast/core/file.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+namespace fs = std::filesystem;
+
+namespace {
+
+// Так RequestHandler::handleRequest читал файл на каждый запрос
+size_t ReadFromDisk(const std::string& root, const std::string& target) {
+    const std::string path = root + target;
+    const fs::path requested = fs::weakly_canonical(path);
+    const fs::path root_path = fs::weakly_canonical(root);
+    if (std::mismatch(root_path.begin(), root_path.end(), requested.begin(), requested.end()).first != root_path.end()) {
+        return 0;
+    }
+    boost::beast::file file;
+    boost::beast::error_code ec;
+    file.open(path.c_str(), boost::beast::file_mode::read, ec);
+    if (ec) {
+        return 0;
+    }
+    const size_t size = file.size(ec);
+    // Сервер отправлял файл кусками через буфер, здесь он читается так же целиком
+    std::string buffer(size, '\0');
+    file.read(buffer.data(), size, ec);
+    return size;
+}
+
+template <typename Fn>
+double MeasureUsPerRequest(const std::vector<std::string>& targets, Fn&& serve) {
+    constexpr int rounds = 20;
+    size_t bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (const auto& target : targets) {
+            bytes += serve(target);
+        }
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (bytes == 0) {
+        std::cerr << "nothing served"sv << std::endl;
+    }
+    return std::chrono::duration<double, std::micro>(elapsed).count() / (targets.size() * rounds);
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    const std::string root = argc > 1 ? argv[1] : "static";
+
+    const auto load_start = std::chrono::steady_clock::now();
+    const static_content::StaticCache cache{root};
+    std::cout << "files: "sv << cache.Size() << "\tcache load: "sv
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count()
+              << " ms"sv << std::endl;
+
+    std::vector<std::string> targets;
+    for (const auto& entry : fs::recursive_directory_iterator(root)) {
+        if (entry.is_regular_file()) {
+            targets.push_back("/" + entry.path().lexically_relative(root).generic_string());
+        }
+    }
+
+    std::cout << "disk  "sv << MeasureUsPerRequest(targets, [&root](const std::string& target) {
+        return ReadFromDisk(root, target);
+    }) << " us/request"sv << std::endl;
+    std::cout << "cache "sv << MeasureUsPerRequest(targets, [&cache](const std::string& target) {
+        const auto* file = cache.Find(target);
+        return file->GetVariant(static_content::ChooseEncoding("gzip, deflate, br"sv, *file)).body->size();
+    }) << " us/request"sv << std::endl;
+
+    for (const auto& [name, accept_encoding] : {std::pair{"identity"sv, ""sv}, std::pair{"gzip    "sv, "gzip"sv},
+                                                std::pair{"br      "sv, "gzip, deflate, br"sv}}) {
+        size_t bytes = 0;
+        for (const auto& target : targets) {
+            const auto* file = cache.Find(target);
+            bytes += file->GetVariant(static_content::ChooseEncoding(accept_encoding, *file)).body->size();
+        }
+        std::cout << name << "\t"sv << bytes << " bytes for all files"sv << std::endl;
+    }
+}
@@ -0,0 +1,79 @@
+// Микробенчмарк авторизации: поиск игрока по токену при 10..1M игроков.
+// Индекс по 128-битному ключу сравнивается с прежним линейным перебором строк
+#include "../src/model.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+using namespace std::literals;
+
+namespace {
+
+// Линейный перебор — так работал Players::findPlayerByToken до появления индекса
+const model::Player* FindPlayerLinear(const std::vector<model::Players::PlayerPointer>& players, const Token& token) {
+    for (const auto& player : players) {
+        if (player->GetToken() == token) {
+            return player.get();
+        }
+    }
+    return nullptr;
+}
+
+template <typename Fn>
+double MeasureNsPerLookup(const std::vector<std::string>& tokens, Fn&& find) {
+    const auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (const auto& token : tokens) {
+        found += find(token) != nullptr;
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (found != tokens.size()) {
+        std::cerr << "some tokens not found"sv << std::endl;
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() / tokens.size();
+}
+
+}  // namespace
+
+int main() {
+    model::Map map{model::Map::Id{"bench"s}, "bench"s};
+    map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 100});
+    map.BuildRoadGraph();
+
+    // Линейный перебор дальше 100k игроков занимает минуты и ничего нового не показывает
+    constexpr size_t max_linear_players = 100'000;
+    constexpr size_t lookups = 100'000;
+
+    model::Players players;
+    std::vector<model::Players::PlayerPointer> all_players;
+    auto session = std::make_shared<model::GameSession>(model::GameSession::Id{"0"s}, map);
+    for (size_t count : {10, 1'000, 100'000, 1'000'000}) {
+        while (all_players.size() < count) {
+            all_players.push_back(players.AddPlayer("dog"s, session, false));
+        }
+
+        std::mt19937 gen{42};
+        std::uniform_int_distribution<size_t> pick(0, count - 1);
+        const size_t linear_lookups = count <= 1'000 ? lookups : 1'000;
+        std::vector<std::string> tokens;
+        tokens.reserve(lookups);
+        for (size_t i = 0; i < lookups; ++i) {
+            tokens.push_back(*all_players[pick(gen)]->GetToken());
+        }
+
+        const double indexed = MeasureNsPerLookup(tokens, [&players](const std::string& token) {
+            const auto key = model::ParseTokenKey(token);
+            return key ? players.findPlayerByToken(*key) : nullptr;
+        });
+        std::cout << "players: "sv << count << "\tindex: "sv << indexed << " ns/lookup"sv;
+        if (count <= max_linear_players) {
+            const std::vector<std::string> linear_tokens(tokens.begin(), tokens.begin() + linear_lookups);
+            const double linear = MeasureNsPerLookup(linear_tokens, [&all_players](const std::string& token) {
+                return FindPlayerLinear(all_players, Token{token});
+            });
+            std::cout << "\tlinear: "sv << linear << " ns/lookup"sv;
+        }
+        std::cout << std::endl;
+    }
+}
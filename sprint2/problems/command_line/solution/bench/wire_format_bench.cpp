@@ -0,0 +1,55 @@
+// Размер и время формирования ответа /api/v1/game/state в JSON и в CBOR
+// (Accept: application/cbor) с полной точностью координат и с округлением до сотых
+#include "../src/game_serializer.h"
+#include "../src/model.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+
+using namespace std::literals;
+
+namespace {
+
+// Снимок нельзя перемещать (в нём лежат once_flag кэшированных тел), поэтому он создаётся в куче
+std::unique_ptr<model::SessionSnapshot> MakeSnapshot(size_t dogs) {
+    std::mt19937 gen{42};
+    std::uniform_real_distribution<double> coord(0, 100);
+    std::uniform_int_distribution<int> moving(0, 1);
+    auto snapshot = std::make_unique<model::SessionSnapshot>();
+    for (size_t i = 0; i < dogs; ++i) {
+        // Скорость пса — это скорость карты по одной из осей или ноль
+        const double speed = moving(gen) ? 1.5 : 0.0;
+        snapshot->dogs.push_back({{coord(gen), coord(gen)}, {speed, 0}, model::Direction::EAST});
+    }
+    return snapshot;
+}
+
+void Measure(std::string_view name, const model::SessionSnapshot& snapshot, int iterations,
+             std::optional<int> coord_decimals, game_serializer::Format format) {
+    size_t bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        bytes += game_serializer::SerializeState(snapshot, coord_decimals, format).size();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << "\tdogs: "sv << snapshot.dogs.size()
+              << "\t"sv << std::chrono::duration<double, std::nano>(elapsed).count() / iterations << " ns/response"sv
+              << "\t"sv << bytes / iterations << " bytes"sv << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    using game_serializer::Format;
+    for (size_t dogs : {10, 1'000, 10'000}) {
+        const auto snapshot = MakeSnapshot(dogs);
+        const int iterations = static_cast<int>(2'000'000 / dogs);
+        Measure("json       "sv, *snapshot, iterations, std::nullopt, Format::JSON);
+        Measure("cbor       "sv, *snapshot, iterations, std::nullopt, Format::CBOR);
+        Measure("json fixed2"sv, *snapshot, iterations, 2, Format::JSON);
+        Measure("cbor fixed2"sv, *snapshot, iterations, 2, Format::CBOR);
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace cbor_writer {
+
+/**
+ * Потоковая запись CBOR (RFC 8949) в строку с тем же интерфейсом, что у json_writer::JsonWriter,
+ * поэтому один и тот же код сериализации модели выдаёт и JSON, и CBOR.
+ * Объекты и массивы записываются с неопределённой длиной (0xBF/0x9F ... 0xFF):
+ * так не нужно заранее знать число элементов.
+ */
+class CborWriter {
+public:
+    explicit CborWriter(std::string& out) noexcept
+        : out_{out} {
+    }
+
+    CborWriter& BeginObject() {
+        out_ += static_cast<char>(0xBF);
+        return *this;
+    }
+    CborWriter& EndObject() {
+        out_ += static_cast<char>(BREAK);
+        return *this;
+    }
+    CborWriter& BeginArray() {
+        out_ += static_cast<char>(0x9F);
+        return *this;
+    }
+    CborWriter& EndArray() {
+        out_ += static_cast<char>(BREAK);
+        return *this;
+    }
+
+    CborWriter& Key(std::string_view key) {
+        return String(key);
+    }
+
+    CborWriter& String(std::string_view value) {
+        WriteHead(MAJOR_TEXT, value.size());
+        out_.append(value);
+        return *this;
+    }
+
+    CborWriter& Bool(bool value) {
+        out_ += static_cast<char>(value ? 0xF5 : 0xF4);
+        return *this;
+    }
+
+    CborWriter& Int(int64_t value) {
+        if (value >= 0) {
+            WriteHead(MAJOR_UNSIGNED, static_cast<uint64_t>(value));
+        } else {
+            // Отрицательное число -1 - n кодируется значением n
+            WriteHead(MAJOR_NEGATIVE, static_cast<uint64_t>(-1 - value));
+        }
+        return *this;
+    }
+
+    // Целые значения пишутся как целые, остальные — как float32, если он хранит
+    // число точно, иначе как float64
+    CborWriter& Double(double value) {
+        if (std::trunc(value) == value && std::fabs(value) < MAX_EXACT_INTEGER && !(value == 0 && std::signbit(value))) {
+            return Int(static_cast<int64_t>(value));
+        }
+        if (static_cast<double>(static_cast<float>(value)) == value || !std::isfinite(value)) {
+            WriteFloat(static_cast<float>(value));
+        } else {
+            WriteDouble(value);
+        }
+        return *this;
+    }
+
+    // Значение с точностью до decimals знаков после запятой. Если float32 обеспечивает
+    // такую точность, пишется он: 5 байт вместо 9
+    CborWriter& Fixed(double value, int decimals) {
+        const double scale = std::pow(10.0, decimals);
+        const double rounded = std::round(value * scale) / scale;
+        if (!std::isfinite(rounded)) {
+            return Double(value);
+        }
+        if (std::trunc(rounded) == rounded && std::fabs(rounded) < MAX_EXACT_INTEGER) {
+            return Int(static_cast<int64_t>(rounded));
+        }
+        const auto as_float = static_cast<float>(rounded);
+        if (std::fabs(static_cast<double>(as_float) - rounded) * scale < 0.5) {
+            WriteFloat(as_float);
+        } else {
+            WriteDouble(rounded);
+        }
+        return *this;
+    }
+
+private:
+    static constexpr uint8_t MAJOR_UNSIGNED = 0;
+    static constexpr uint8_t MAJOR_NEGATIVE = 1;
+    static constexpr uint8_t MAJOR_TEXT = 3;
+    static constexpr uint8_t BREAK = 0xFF;
+    static constexpr double MAX_EXACT_INTEGER = 9007199254740992.0;
+
+    // Заголовок элемента: старшие 3 бита — тип, младшие 5 — значение или размер следующего за ним числа
+    void WriteHead(uint8_t major, uint64_t value) {
+        const auto type = static_cast<uint8_t>(major << 5);
+        if (value < 24) {
+            out_ += static_cast<char>(type | value);
+        } else if (value <= 0xFF) {
+            out_ += static_cast<char>(type | 24);
+            WriteBigEndian(value, 1);
+        } else if (value <= 0xFFFF) {
+            out_ += static_cast<char>(type | 25);
+            WriteBigEndian(value, 2);
+        } else if (value <= 0xFFFFFFFF) {
+            out_ += static_cast<char>(type | 26);
+            WriteBigEndian(value, 4);
+        } else {
+            out_ += static_cast<char>(type | 27);
+            WriteBigEndian(value, 8);
+        }
+    }
+
+    void WriteBigEndian(uint64_t value, int bytes) {
+        char buffer[8];
+        for (int i = bytes - 1; i >= 0; --i) {
+            buffer[i] = static_cast<char>(value & 0xFF);
+            value >>= 8;
+        }
+        out_.append(buffer, bytes);
+    }
+
+    void WriteFloat(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        out_ += static_cast<char>(0xFA);
+        WriteBigEndian(bits, 4);
+    }
+
+    void WriteDouble(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        out_ += static_cast<char>(0xFB);
+        WriteBigEndian(bits, 8);
+    }
+
+    std::string& out_;
+};
+
+}  // namespace cbor_writer
@@ -0,0 +1,285 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+namespace http_server {
+
+/**
+ * Память соединения для запросов, ответов и асинхронных операций над ними.
+ * Выделение — сдвиг указателя в текущем блоке, освобождение ничего не возвращает.
+ * Когда таких живых выделений не остаётся, TryReset() перематывает арену в начало:
+ * блоки не освобождаются, а используются заново, поэтому соединение в установившемся
+ * режиме не обращается к куче.
+ *
+ * Память обработчиков асинхронных операций устроена иначе (AllocateHandler): освобождённый
+ * блок сразу возвращается в список свободных блоков своего размера и достаётся следующей
+ * операции. Иначе при конвейерных запросах, когда арену не удаётся перемотать, каждое
+ * чтение и запись занимали бы в ней новое место.
+ *
+ * Запрос может пережить соединение (обработчик держит его в strand'е игровой сессии),
+ * поэтому арена удаляется, когда её отпустили и владелец (Release), и последнее выделение.
+ * Выделять и освобождать можно из любых потоков.
+ */
+class ConnectionArena {
+public:
+    static constexpr size_t INITIAL_BLOCK_SIZE = 16 * 1024;
+
+    static ConnectionArena* Create() {
+        return new ConnectionArena();
+    }
+
+    ConnectionArena(const ConnectionArena&) = delete;
+    ConnectionArena& operator=(const ConnectionArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment) {
+        std::lock_guard lock{mutex_};
+        for (;;) {
+            const auto begin = reinterpret_cast<std::uintptr_t>(current_->Data());
+            const auto aligned = (begin + offset_ + alignment - 1) & ~(std::uintptr_t{alignment} - 1);
+            if (aligned + size <= begin + current_->size) {
+                offset_ = aligned + size - begin;
+                // Счётчик меняется под блокировкой, чтобы TryReset не перемотал арену
+                // между проверкой счётчика и выделением
+                ++bump_live_;
+                refs_.fetch_add(1, std::memory_order_relaxed);
+                return reinterpret_cast<void*>(aligned);
+            }
+            NextBlock(size + alignment);
+        }
+    }
+
+    void Deallocate() noexcept {
+        {
+            std::lock_guard lock{mutex_};
+            --bump_live_;
+        }
+        Unref();
+    }
+
+    void* AllocateHandler(size_t size) {
+        const size_t size_class = GetSizeClass(size);
+        if (size_class == HANDLER_SIZE_CLASSES) {
+            return Allocate(size, alignof(std::max_align_t));
+        }
+        std::lock_guard lock{mutex_};
+        FreeHandler*& head = free_handlers_[size_class];
+        void* memory = head;
+        if (head) {
+            head = head->next;
+        } else {
+            memory = std::malloc(MIN_HANDLER_SIZE << size_class);
+            if (!memory) {
+                throw std::bad_alloc{};
+            }
+            ++block_count_;
+        }
+        refs_.fetch_add(1, std::memory_order_relaxed);
+        return memory;
+    }
+
+    void DeallocateHandler(void* memory, size_t size) noexcept {
+        const size_t size_class = GetSizeClass(size);
+        if (size_class != HANDLER_SIZE_CLASSES) {
+            std::lock_guard lock{mutex_};
+            free_handlers_[size_class] = new (memory) FreeHandler{free_handlers_[size_class]};
+        } else {
+            std::lock_guard lock{mutex_};
+            --bump_live_;
+        }
+        Unref();
+    }
+
+    // Перематывает арену, если в ней не осталось живых выделений. Блоки обработчиков
+    // лежат вне арены и не мешают: ожидающий таймер не должен её держать. Вызывается владельцем
+    bool TryReset() noexcept {
+        std::lock_guard lock{mutex_};
+        if (bump_live_ != 0) {
+            return false;
+        }
+        current_ = &first_;
+        offset_ = 0;
+        return true;
+    }
+
+    // Владелец больше не пользуется ареной
+    void Release() noexcept {
+        Unref();
+    }
+
+    // Сколько раз арене пришлось брать память из кучи
+    size_t GetBlockCount() const noexcept {
+        std::lock_guard lock{mutex_};
+        return block_count_;
+    }
+
+private:
+    // Размеры блоков для обработчиков: 64, 128, ..., 4096 байт. Обработчики крупнее
+    // размещаются как обычные выделения арены
+    static constexpr size_t MIN_HANDLER_SIZE = 64;
+    static constexpr size_t HANDLER_SIZE_CLASSES = 7;
+
+    struct FreeHandler {
+        FreeHandler* next;
+    };
+
+    static size_t GetSizeClass(size_t size) noexcept {
+        size_t size_class = 0;
+        while (size_class != HANDLER_SIZE_CLASSES && (MIN_HANDLER_SIZE << size_class) < size) {
+            ++size_class;
+        }
+        return size_class;
+    }
+
+    // Заголовок блока; память блока идёт сразу за ним
+    struct alignas(std::max_align_t) Block {
+        Block* next = nullptr;
+        size_t size = 0;
+
+        char* Data() noexcept {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    };
+
+    // Первый блок лежит внутри самой арены
+    struct InitialBlock {
+        Block header{nullptr, INITIAL_BLOCK_SIZE};
+        alignas(std::max_align_t) char data[INITIAL_BLOCK_SIZE];
+    };
+
+    ConnectionArena() = default;
+
+    ~ConnectionArena() {
+        for (Block* block = first_.next; block;) {
+            Block* next = block->next;
+            std::free(block);
+            block = next;
+        }
+        for (FreeHandler* head : free_handlers_) {
+            while (head) {
+                FreeHandler* next = head->next;
+                std::free(head);
+                head = next;
+            }
+        }
+    }
+
+    void Unref() noexcept {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    // Переходит к следующему блоку, в котором поместится min_size байт, при необходимости создавая его
+    void NextBlock(size_t min_size) {
+        Block* next = current_->next;
+        if (!next || next->size < min_size) {
+            const size_t size = std::max(min_size, current_->size * 2);
+            void* memory = std::malloc(sizeof(Block) + size);
+            if (!memory) {
+                throw std::bad_alloc{};
+            }
+            // Новый блок вставляется после текущего; меньший блок, если он был, сдвигается дальше
+            next = new (memory) Block{current_->next, size};
+            current_->next = next;
+            ++block_count_;
+        }
+        current_ = next;
+        offset_ = 0;
+    }
+
+    mutable std::mutex mutex_;
+    InitialBlock initial_;
+    Block& first_ = initial_.header;
+    Block* current_ = &first_;
+    size_t offset_ = 0;
+    size_t block_count_ = 0;
+    FreeHandler* free_handlers_[HANDLER_SIZE_CLASSES] = {};
+    // Живые выделения, размещённые сдвигом указателя
+    size_t bump_live_ = 0;
+    // Все живые выделения, включая блоки обработчиков, плюс ссылка владельца
+    std::atomic<size_t> refs_{1};
+};
+
+// Распределитель для контейнеров и асинхронных операций соединения
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    explicit ArenaAllocator(ConnectionArena* arena) noexcept
+        : arena_{arena} {
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+        : arena_{other.GetArena()} {
+    }
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) noexcept {
+        arena_->Deallocate();
+    }
+
+    ConnectionArena* GetArena() const noexcept {
+        return arena_;
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept {
+        return arena_ == other.GetArena();
+    }
+
+private:
+    ConnectionArena* arena_;
+};
+
+// Распределитель для обработчиков асинхронных операций соединения: память переиспользуется,
+// как только операция завершилась
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(ConnectionArena* arena) noexcept
+        : arena_{arena} {
+    }
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept
+        : arena_{other.GetArena()} {
+    }
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena_->AllocateHandler(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        arena_->DeallocateHandler(p, n * sizeof(T));
+    }
+
+    ConnectionArena* GetArena() const noexcept {
+        return arena_;
+    }
+
+    template <typename U>
+    bool operator==(const HandlerAllocator<U>& other) const noexcept {
+        return arena_ == other.GetArena();
+    }
+
+private:
+    ConnectionArena* arena_;
+};
+
+}  // namespace http_server
@@ -0,0 +1,196 @@
+#pragma once
+#include "cbor_writer.h"
+#include "json_writer.h"
+#include "model.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace game_serializer {
+
+// Формат тела ответа. Значение — индекс в SessionSnapshot::CachedBodies
+enum class Format : size_t {
+    JSON = 0,
+    CBOR = 1
+};
+static_assert(model::SessionSnapshot::BODY_FORMAT_COUNT == 2);
+
+constexpr std::string_view ContentType(Format format) {
+    return format == Format::CBOR ? "application/cbor" : "application/json";
+}
+
+// Функции ниже принимают любой Writer с интерфейсом json_writer::JsonWriter
+// (json_writer::JsonWriter, cbor_writer::CborWriter), поэтому структура ответа
+// описана один раз для всех форматов
+namespace detail {
+
+// Примерный размер записи об одном псе, чтобы строка не перевыделялась по ходу записи
+constexpr size_t DOG_RECORD_SIZE = 96;
+
+template <typename Writer>
+void WriteIdKey(Writer& writer, size_t id) {
+    char key[24];
+    const auto key_end = std::to_chars(key, key + sizeof(key), id).ptr;
+    writer.Key({key, static_cast<size_t>(key_end - key)});
+}
+
+// "<id>":{"pos":[x,y],"speed":[vx,vy],"dir":"U"}
+template <typename Writer>
+void WriteDog(Writer& writer, size_t id, const model::SessionSnapshot::DogState& dog,
+              std::optional<int> coord_decimals) {
+    WriteIdKey(writer, id);
+    writer.BeginObject().Key("pos").BeginArray();
+    if (coord_decimals) {
+        writer.Fixed(dog.coordinate.x, *coord_decimals).Fixed(dog.coordinate.y, *coord_decimals);
+    } else {
+        writer.Double(dog.coordinate.x).Double(dog.coordinate.y);
+    }
+    writer.EndArray()
+        .Key("speed").BeginArray().Double(dog.speed.vx).Double(dog.speed.vy).EndArray()
+        .Key("dir").String(model::DirectionToString(dog.direction))
+        .EndObject();
+}
+
+template <typename Writer>
+void WriteMap(Writer& writer, const model::Map& map) {
+    writer.BeginObject()
+        .Key("id").String(*map.GetId())
+        .Key("name").String(map.GetName())
+        .Key("roads").BeginArray();
+    for (const auto& road : map.GetRoads()) {
+        writer.BeginObject().Key("x0").Int(road.GetStart().x).Key("y0").Int(road.GetStart().y);
+        if (road.IsHorizontal()) {
+            writer.Key("x1").Int(road.GetEnd().x);
+        } else {
+            writer.Key("y1").Int(road.GetEnd().y);
+        }
+        writer.EndObject();
+    }
+    writer.EndArray().Key("buildings").BeginArray();
+    for (const auto& building : map.GetBuildings()) {
+        const auto& bounds = building.GetBounds();
+        writer.BeginObject()
+            .Key("x").Int(bounds.position.x)
+            .Key("y").Int(bounds.position.y)
+            .Key("w").Int(bounds.size.width)
+            .Key("h").Int(bounds.size.height)
+            .EndObject();
+    }
+    writer.EndArray().Key("offices").BeginArray();
+    for (const auto& office : map.GetOffices()) {
+        writer.BeginObject()
+            .Key("id").String(*office.GetId())
+            .Key("x").Int(office.GetPosition().x)
+            .Key("y").Int(office.GetPosition().y)
+            .Key("offsetX").Int(office.GetOffset().dx)
+            .Key("offsetY").Int(office.GetOffset().dy)
+            .EndObject();
+    }
+    writer.EndArray().EndObject();
+}
+
+// Вызывает fn с писателем нужного формата, пишущим в out
+template <typename Fn>
+std::string WithWriter(Format format, size_t reserve, Fn&& fn) {
+    std::string out;
+    out.reserve(reserve);
+    if (format == Format::CBOR) {
+        cbor_writer::CborWriter writer{out};
+        fn(writer);
+    } else {
+        json_writer::JsonWriter writer{out};
+        fn(writer);
+    }
+    return out;
+}
+
+}  // namespace detail
+
+// Тело ответа /api/v1/game/state: {"players":{"<id>":{"pos":[x,y],"speed":[vx,vy],"dir":"U"}}}.
+// Если задано coord_decimals, координаты округляются до этого числа знаков после запятой:
+// ответ становится короче и форматируется быстрее
+inline std::string SerializeState(const model::SessionSnapshot& snapshot, std::optional<int> coord_decimals = std::nullopt,
+                                  Format format = Format::JSON) {
+    return detail::WithWriter(format, 32 + snapshot.dogs.size() * detail::DOG_RECORD_SIZE, [&](auto& writer) {
+        writer.BeginObject().Key("players").BeginObject();
+        for (size_t id = 0; id < snapshot.dogs.size(); ++id) {
+            detail::WriteDog(writer, id, snapshot.dogs[id], coord_decimals);
+        }
+        writer.EndObject().EndObject();
+    });
+}
+
+// Тело ответа /api/v1/game/state?radius=<r>: то же, что SerializeState, но только псы dog_ids
+inline std::string SerializeStateOf(const model::SessionSnapshot& snapshot, const std::vector<size_t>& dog_ids,
+                                    std::optional<int> coord_decimals = std::nullopt, Format format = Format::JSON) {
+    return detail::WithWriter(format, 32 + dog_ids.size() * detail::DOG_RECORD_SIZE, [&](auto& writer) {
+        writer.BeginObject().Key("players").BeginObject();
+        for (const size_t id : dog_ids) {
+            detail::WriteDog(writer, id, snapshot.dogs[id], coord_decimals);
+        }
+        writer.EndObject().EndObject();
+    });
+}
+
+// Тело ответа /api/v1/game/state?since=<version>:
+// {"version":N,"full":false,"players":{только псы, изменившиеся после версии since}}.
+// Если since больше текущей версии (например, сервер перезапущен) или клиент пропустил
+// больше SessionSnapshot::MAX_DELTA_TICKS тиков, отправляются все псы и "full":true
+inline std::string SerializeStateSince(const model::SessionSnapshot& snapshot, std::uint64_t since,
+                                       std::optional<int> coord_decimals = std::nullopt, Format format = Format::JSON) {
+    const bool full = since > snapshot.version || since < snapshot.oldest_delta_version;
+    size_t changed = snapshot.dogs.size();
+    if (!full) {
+        changed = 0;
+        for (const auto version : snapshot.changed_at) {
+            changed += version > since;
+        }
+    }
+    return detail::WithWriter(format, 64 + changed * detail::DOG_RECORD_SIZE, [&](auto& writer) {
+        writer.BeginObject()
+            .Key("version").Int(static_cast<int64_t>(snapshot.version))
+            .Key("full").Bool(full)
+            .Key("players").BeginObject();
+        for (size_t id = 0; id < snapshot.dogs.size(); ++id) {
+            if (full || snapshot.changed_at[id] > since) {
+                detail::WriteDog(writer, id, snapshot.dogs[id], coord_decimals);
+            }
+        }
+        writer.EndObject().EndObject();
+    });
+}
+
+// Тело ответа /api/v1/game/players: {"<id>":{"name":"<имя пса>"}}
+inline std::string SerializePlayers(const model::SessionSnapshot& snapshot, Format format = Format::JSON) {
+    return detail::WithWriter(format, 2 + snapshot.names->size() * 32, [&](auto& writer) {
+        writer.BeginObject();
+        for (size_t id = 0; id < snapshot.names->size(); ++id) {
+            detail::WriteIdKey(writer, id);
+            writer.BeginObject().Key("name").String((*snapshot.names)[id]).EndObject();
+        }
+        writer.EndObject();
+    });
+}
+
+// Тело ответа /api/v1/maps: [{"id":"map1","name":"Map 1"}, ...]
+inline std::string SerializeMapList(const model::Game::Maps& maps, Format format = Format::JSON) {
+    return detail::WithWriter(format, 2 + maps.size() * 64, [&](auto& writer) {
+        writer.BeginArray();
+        for (const auto& map : maps) {
+            writer.BeginObject().Key("id").String(*map.GetId()).Key("name").String(map.GetName()).EndObject();
+        }
+        writer.EndArray();
+    });
+}
+
+// Тело ответа /api/v1/maps/{id}: карта с дорогами, зданиями и офисами
+inline std::string SerializeMap(const model::Map& map, Format format = Format::JSON) {
+    return detail::WithWriter(format, 256 + map.GetRoads().size() * 40, [&](auto& writer) {
+        detail::WriteMap(writer, map);
+    });
+}
+
+}  // namespace game_serializer
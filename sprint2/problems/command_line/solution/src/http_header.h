@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <string_view>
+#include <system_error>
+
+namespace http_header {
+
+inline bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs) noexcept {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](unsigned char l, unsigned char r) {
+        return std::tolower(l) == std::tolower(r);
+    });
+}
+
+// Убирает пробелы и табуляции по краям
+inline std::string_view Trim(std::string_view s) noexcept {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// Вес q из параметров элемента списка ("level=1;q=0.5"). Параметр q ищется среди
+// всех параметров, а не только первого. Без q вес равен 1, нечитаемый q — 0
+inline double ParseQuality(std::string_view params) noexcept {
+    while (!params.empty()) {
+        const size_t next = params.find(';');
+        const std::string_view param = Trim(params.substr(0, next));
+        params = next == std::string_view::npos ? std::string_view{} : params.substr(next + 1);
+        if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+            double q = 0;
+            if (std::from_chars(param.data() + 2, param.data() + param.size(), q).ec != std::errc{}) {
+                return 0;
+            }
+            return q;
+        }
+    }
+    return 1;
+}
+
+// Обходит список с весами вида "value;param=x;q=0.5, value2" (Accept, Accept-Encoding)
+// и вызывает fn(value, q) для каждого непустого элемента в порядке следования
+template <typename Fn>
+void ForEachWeighted(std::string_view header, Fn&& fn) {
+    while (!header.empty()) {
+        const size_t comma = header.find(',');
+        const std::string_view item = header.substr(0, comma);
+        header = comma == std::string_view::npos ? std::string_view{} : header.substr(comma + 1);
+
+        const size_t semicolon = item.find(';');
+        const std::string_view value = Trim(item.substr(0, semicolon));
+        if (value.empty()) {
+            continue;
+        }
+        fn(value, semicolon == std::string_view::npos ? 1.0 : ParseQuality(item.substr(semicolon + 1)));
+    }
+}
+
+}  // namespace http_header
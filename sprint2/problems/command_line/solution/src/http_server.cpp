@@ -5,11 +5,345 @@
 
 namespace http_server {
     void SessionBase::Run() {
-    // Вызываем метод Read, используя executor объекта stream_.
-    // Таким образом вся работа со stream_ будет выполняться, используя его executor
-    net::dispatch(stream_.get_executor(),
+    // Вызываем метод Read, используя executor объекта socket_.
+    // Таким образом вся работа с socket_ будет выполняться, используя его executor
+    net::dispatch(socket_.get_executor(),
                   beast::bind_front_handler(&SessionBase::Read, GetSharedThis()));
     }
+
+    SessionBase::SessionBase(ConnectionSocket&& socket)
+        : arena_(ConnectionArena::Create())
+        , socket_(std::move(socket))
+        , request_(MakeArenaRequest(arena_))
+        , timer_(socket_.get_executor()) {
+    }
+
+    SessionBase::~SessionBase() {
+        // Поля, выделенные в арене, разрушаются раньше, чем сессия отпустит арену
+        upgrade_request_.reset();
+        writing_response_.reset();
+        ClearPending();
+        request_ = MakeArenaRequest(arena_);
+        arena_->Release();
+    }
+
+    ArenaRequest MakeArenaRequest(ConnectionArena* arena) {
+        const ArenaRequestAllocator allocator{arena};
+        return ArenaRequest{std::piecewise_construct, std::make_tuple(allocator), std::make_tuple(allocator)};
+    }
+
+    WebSocketSession::HttpRequest MakeWebSocketRequest(const ArenaRequest& request) {
+        WebSocketSession::HttpRequest ws_request{request.method(), request.target(), request.version()};
+        for (const auto& field : request) {
+            ws_request.insert(field.name_string(), field.value());
+        }
+        ws_request.body().assign(request.body().data(), request.body().size());
+        return ws_request;
+    }
+
+    void SessionBase::ExtendDeadline() {
+        deadline_ = std::chrono::steady_clock::now() + IO_TIMEOUT;
+        if (!timer_waiting_) {
+            WaitTimer();
+        }
+    }
+
+    void SessionBase::WaitTimer() {
+        timer_waiting_ = true;
+        timer_.expires_at(deadline_);
+        timer_.async_wait(ArenaBoundHandler{beast::bind_front_handler(&SessionBase::OnTimer, GetSharedThis()), arena_});
+    }
+
+    void SessionBase::OnTimer(beast::error_code ec) {
+        timer_waiting_ = false;
+        if (ec || (!reading_ && !writing_)) {
+            // Таймер отменён или ждать нечего: следующее чтение или запись запустят его снова
+            return;
+        }
+        if (std::chrono::steady_clock::now() < deadline_) {
+            return WaitTimer();
+        }
+        // Клиент слишком долго молчит или не забирает ответ: прерываем операции с сокетом
+        timed_out_ = true;
+        beast::error_code ignored;
+        socket_.cancel(ignored);
+    }
+
+    void SessionBase::Read() {
+        reading_ = true;
+        // Очищаем запрос от прежнего значения (метод Read может быть вызван несколько раз)
+        request_ = MakeArenaRequest(arena_);
+        // Если все ответы отправлены и обработчики отпустили запросы, память арены
+        // используется заново. Иначе она растёт до следующего такого момента
+        if (pending_count_ == 0 && !writing_) {
+            arena_->TryReset();
+        }
+        ExtendDeadline();
+        // Считываем request_ из socket_, используя buffer_ для хранения считанных данных.
+        // Если клиент прислал несколько запросов подряд, следующий уже лежит в buffer_
+        http::async_read(socket_, buffer_, request_,
+                         // По окончании операции будет вызван метод OnRead
+                         ArenaBoundHandler{beast::bind_front_handler(&SessionBase::OnRead, GetSharedThis()), arena_});
+    }
+
+    void SessionBase::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
+        reading_ = false;
+        if (ec == http::error::end_of_stream || timed_out_) {
+            // Нормальная ситуация - клиент закрыл соединение или долго молчал.
+            // Ответы на уже прочитанные запросы всё равно отправляются
+            read_closed_ = true;
+            if (pending_count_ == 0 && !writing_) {
+                Close();
+            }
+            return;
+        }
+        if (ec) {
+            read_closed_ = true;
+            return ReportError(ec, "read"sv);
+        }
+        if (websocket::is_upgrade(request_)) {
+            // Дальше соединением владеет WebSocketSession, а эта сессия завершается.
+            // Если ещё не все ответы отправлены, подключение откладывается до их отправки
+            read_closed_ = true;
+            if (pending_count_ == 0 && !writing_) {
+                return Upgrade(std::move(request_));
+            }
+            upgrade_request_ = std::move(request_);
+            return;
+        }
+        if (!request_.keep_alive()) {
+            // Клиент закроет соединение после ответа, дальше читать нечего
+            read_closed_ = true;
+        }
+        const RequestId id = first_pending_id_ + pending_count_;
+        ++pending_count_;
+        HandleRequest(std::move(request_), id);
+        ContinueReading();
+    }
+
+    void SessionBase::ContinueReading() {
+        if (reading_ || read_closed_ || pending_count_ == MAX_PIPELINED_REQUESTS) {
+            return;
+        }
+        // Запросы, которые клиент прислал конвейером, уже лежат в buffer_ и разбираются сразу,
+        // не дожидаясь ответа на предыдущие. Если буфер пуст, следующий запрос читаем после
+        // отправки ответов: тогда арену соединения можно будет перемотать перед чтением
+        if (buffer_.size() != 0 || pending_count_ == 0) {
+            Read();
+        }
+    }
+
+    void SessionBase::ClearPending() {
+        for (; pending_count_ != 0; --pending_count_, ++first_pending_id_) {
+            GetPending(first_pending_id_) = {};
+        }
+    }
+
+    void SessionBase::SetResponse(RequestId id, bool close, std::shared_ptr<void> response, WriteFn write) {
+        if (id < first_pending_id_ || id - first_pending_id_ >= pending_count_) {
+            // Соединение уже закрывается, ответ никто не ждёт
+            return;
+        }
+        auto& pending = GetPending(id);
+        pending.response = std::move(response);
+        pending.write = write;
+        pending.close = close;
+        if (!writing_) {
+            WriteNext();
+        }
+    }
+
+    void SessionBase::WriteNext() {
+        // Пока не готов ответ на самый ранний запрос, готовые ответы на следующие ждут
+        if (pending_count_ == 0 || !GetPending(first_pending_id_).response) {
+            return;
+        }
+        writing_ = true;
+        ExtendDeadline();
+        auto& pending = GetPending(first_pending_id_);
+        writing_response_ = std::move(pending.response);
+        pending.write(*this, writing_response_);
+    }
+
+    void SessionBase::OnWrite(beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
+        writing_ = false;
+        writing_response_.reset();
+        if (ec) {
+            read_closed_ = true;
+            ClearPending();
+            return ReportError(ec, "write"sv);
+        }
+        const bool close = GetPending(first_pending_id_).close;
+        GetPending(first_pending_id_) = {};
+        --pending_count_;
+        ++first_pending_id_;
+        if (close) {
+            // Семантика ответа требует закрыть соединение; остальные запросы остаются без ответа
+            read_closed_ = true;
+            ClearPending();
+            upgrade_request_.reset();
+            return Close();
+        }
+        WriteNext();
+        ContinueReading();
+        if (pending_count_ == 0 && !writing_) {
+            if (upgrade_request_) {
+                auto request = std::move(*upgrade_request_);
+                upgrade_request_.reset();
+                return Upgrade(std::move(request));
+            }
+            if (read_closed_ && !reading_) {
+                Close();
+            }
+        }
+    }
+
+    void SessionBase::Upgrade(HttpRequest&& request) {
+        auto ws_request = MakeWebSocketRequest(request);
+        timer_.cancel();
+        HandleUpgrade(std::move(ws_request), std::make_shared<WebSocketSession>(std::move(socket_)));
+    }
+
+    void SessionBase::Close() {
+        // Таймер больше не нужен и не должен держать сессию до своего срабатывания
+        timer_.cancel();
+        beast::error_code ec;
+        socket_.shutdown(tcp::socket::shutdown_send, ec);
+    }
+
+    CoroutineConnection::CoroutineConnection(ConnectionSocket&& socket)
+        : arena_(ConnectionArena::Create())
+        , socket_(std::move(socket))
+        , timer_(socket_.get_executor()) {
+        ExtendDeadline();
+    }
+
+    CoroutineConnection::~CoroutineConnection() {
+        arena_->Release();
+    }
+
+    void CoroutineConnection::Stop() {
+        stopped_ = true;
+        timer_.cancel();
+    }
+
+    void CoroutineConnection::Close() {
+        Stop();
+        beast::error_code ec;
+        socket_.shutdown(tcp::socket::shutdown_send, ec);
+    }
+
+    void CoroutineConnection::Close(std::shared_ptr<CoroutineConnection> connection) {
+        const auto executor = connection->socket_.get_executor();
+        net::dispatch(executor, [connection = std::move(connection)] {
+            connection->Close();
+        });
+    }
+
+    ConnectionAwaitable<> CoroutineConnection::WatchDeadline(std::shared_ptr<CoroutineConnection> connection) {
+        // Как и в SessionBase, таймер ждёт срок, который чтение и запись лишь сдвигают,
+        // и не перезапускается на каждый запрос
+        while (!connection->stopped_) {
+            const auto now = std::chrono::steady_clock::now();
+            if (!connection->handling_ && now >= connection->deadline_) {
+                // Клиент слишком долго молчит или не забирает ответ: прерываем операции с сокетом
+                connection->timed_out_ = true;
+                beast::error_code ignored;
+                connection->socket_.cancel(ignored);
+                co_return;
+            }
+            connection->timer_.expires_at(connection->handling_ ? now + IO_TIMEOUT : connection->deadline_);
+            beast::error_code ec;
+            co_await connection->timer_.async_wait(net::redirect_error(CONNECTION_AWAITABLE, ec));
+        }
+    }
+
+    void ReportException(std::exception_ptr exception) {
+        if (!exception) {
+            return;
+        }
+        try {
+            std::rethrow_exception(exception);
+        } catch (const std::exception& ex) {
+            std::cerr << "session: "sv << ex.what() << std::endl;
+        }
+    }
+
+    void WebSocketSession::Accept(HttpRequest&& request, std::function<void()> on_open) {
+        request_ = std::move(request);
+        // Таймауты HTTP-сессии здесь не подходят: соединение живёт долго и почти всё время молчит
+        beast::get_lowest_layer(ws_).expires_never();
+        ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+        ws_.text(true);
+        ws_.async_accept(request_, [self = shared_from_this(), on_open = std::move(on_open)](beast::error_code ec) {
+            if (ec) {
+                return ReportError(ec, "websocket accept"sv);
+            }
+            self->open_.store(true, std::memory_order_release);
+            self->Read();
+            on_open();
+        });
+    }
+
+    void WebSocketSession::Reject(http::response<http::string_body>&& response) {
+        auto safe_response = std::make_shared<http::response<http::string_body>>(std::move(response));
+        safe_response->keep_alive(false);
+        http::async_write(ws_.next_layer(), *safe_response,
+                          [self = shared_from_this(), safe_response](beast::error_code ec, std::size_t) {
+                              beast::error_code ignored;
+                              self->ws_.next_layer().socket().shutdown(tcp::socket::shutdown_send, ignored);
+                              if (ec) {
+                                  ReportError(ec, "websocket reject"sv);
+                              }
+                          });
+    }
+
+    void WebSocketSession::Send(Frame frame) {
+        net::dispatch(ws_.get_executor(), [self = shared_from_this(), frame = std::move(frame)]() mutable {
+            if (!self->IsOpen()) {
+                return;
+            }
+            self->pending_frame_ = std::move(frame);
+            if (!self->writing_frame_) {
+                self->Write();
+            }
+        });
+    }
+
+    void WebSocketSession::Write() {
+        writing_frame_ = std::move(pending_frame_);
+        ws_.async_write(net::buffer(*writing_frame_),
+                        beast::bind_front_handler(&WebSocketSession::OnWrite, shared_from_this()));
+    }
+
+    void WebSocketSession::OnWrite(beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
+        writing_frame_.reset();
+        if (ec) {
+            open_.store(false, std::memory_order_release);
+            return ReportError(ec, "websocket write"sv);
+        }
+        if (pending_frame_) {
+            Write();
+        }
+    }
+
+    // Клиент ничего не присылает, но читать нужно, чтобы обработать ping и закрытие соединения
+    void WebSocketSession::Read() {
+        ws_.async_read(read_buffer_, beast::bind_front_handler(&WebSocketSession::OnRead, shared_from_this()));
+    }
+
+    void WebSocketSession::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
+        if (ec) {
+            open_.store(false, std::memory_order_release);
+            if (ec != websocket::error::closed) {
+                ReportError(ec, "websocket read"sv);
+            }
+            return;
+        }
+        read_buffer_.consume(read_buffer_.size());
+        Read();
+    }
+
     void ReportError(beast::error_code ec, std::string_view what) {
         std::cerr << what << ": "sv << ec.message() << std::endl;
     }
@@ -1,12 +1,32 @@
 #pragma once
 #include "sdk.h"
+#include "connection_arena.h"
 // boost.beast будет использовать std::string_view вместо boost::string_view
 #define BOOST_BEAST_USE_STD_STRING_VIEW
 
+#include <boost/asio/basic_waitable_timer.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/optional.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
 
 
 namespace http_server {
@@ -15,11 +35,219 @@ namespace net = boost::asio;
 using tcp = net::ip::tcp;
 namespace beast = boost::beast;
 namespace http = beast::http;
+namespace websocket = beast::websocket;
 using namespace std::literals;
 namespace sys = boost::system;
 
 void ReportError(beast::error_code ec, std::string_view what);
 
+// Executor соединения. Используется конкретный тип, а не any_io_executor из tcp_stream:
+// копирование и prefer() type-erased executor'а выделяют память на каждую асинхронную операцию
+using ConnectionExecutor = net::strand<net::io_context::executor_type>;
+// Сокет соединения с поддержкой таймаутов. Таймер внутри basic_stream всегда использует
+// any_io_executor, поэтому HTTP-сессия следит за таймаутами сама (ConnectionTimer)
+using ConnectionStream = beast::basic_stream<tcp, ConnectionExecutor>;
+using ConnectionSocket = ConnectionStream::socket_type;
+using ConnectionTimer = net::basic_waitable_timer<std::chrono::steady_clock, net::wait_traits<std::chrono::steady_clock>,
+                                                  ConnectionExecutor>;
+
+// Сколько ждать очередного запроса от клиента или отправки ему ответа
+inline constexpr std::chrono::seconds IO_TIMEOUT{30};
+
+// Как обслуживать соединения: цепочкой обработчиков (Session) или сопрограммой (CoroutineSession)
+enum class SessionModel {
+    CALLBACKS,
+    COROUTINES
+};
+
+// Запрос, заголовки и тело которого лежат в арене соединения. Обработчик может размещать
+// там же заголовки ответа, создав их с распределителем request.get_allocator()
+using ArenaRequestAllocator = ArenaAllocator<char>;
+using ArenaRequest = http::request<http::basic_string_body<char, std::char_traits<char>, ArenaRequestAllocator>,
+                                   http::basic_fields<ArenaRequestAllocator>>;
+
+ArenaRequest MakeArenaRequest(ConnectionArena* arena);
+
+// Выставляет keep-alive и длину тела перед отправкой. Возвращает true,
+// если после этого ответа соединение нужно закрыть
+template <typename Body, typename Fields>
+bool PrepareResponse(http::response<Body, Fields>& response, bool keep_alive) {
+    // Соединение остаётся открытым, если этого хочет клиент, а длина тела известна.
+    // У ответов 1xx, 204 и 304 тела нет, и длина им не нужна
+    response.keep_alive(keep_alive);
+    const unsigned status = response.result_int();
+    const bool has_body = status / 100 != 1 && status != 204 && status != 304;
+    if (has_body && !response.has_content_length() && !response.chunked()) {
+        response.prepare_payload();
+    }
+    return response.need_eof();
+}
+
+// Тело ответа, ссылающееся на общий неизменяемый буфер. В отличие от string_body,
+// один и тот же буфер можно отправить многим клиентам без копирования
+struct SharedStringBody {
+    using value_type = std::shared_ptr<const std::string>;
+
+    static std::uint64_t size(const value_type& body) noexcept {
+        return body ? body->size() : 0;
+    }
+
+    class writer {
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template <bool isRequest, class Fields>
+        writer(const http::header<isRequest, Fields>&, const value_type& body) noexcept
+            : body_{body} {
+        }
+
+        void init(beast::error_code& ec) noexcept {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec) noexcept {
+            ec = {};
+            if (!body_ || body_->empty()) {
+                return boost::none;
+            }
+            // Весь буфер уже в памяти, поэтому отдаём его за один раз
+            return {{const_buffers_type{body_->data(), body_->size()}, false}};
+        }
+
+    private:
+        const value_type& body_;
+    };
+};
+
+// WebSocket-соединение, по которому сервер рассылает клиенту готовые кадры.
+// Кадр — общий неизменяемый буфер, поэтому один кадр уходит всем подписчикам без копирования
+class WebSocketSession : public std::enable_shared_from_this<WebSocketSession> {
+public:
+    using Frame = std::shared_ptr<const std::string>;
+    using HttpRequest = http::request<http::string_body>;
+
+    explicit WebSocketSession(ConnectionSocket&& socket)
+        : ws_(std::move(socket)) {
+    }
+
+    // Завершает рукопожатие. on_open вызывается, когда соединение установлено
+    void Accept(HttpRequest&& request, std::function<void()> on_open);
+    // Отказывает в подключении обычным HTTP-ответом и закрывает соединение
+    void Reject(http::response<http::string_body>&& response);
+
+    // Можно вызывать из любого потока. Кадры не копятся: если клиент не успел
+    // получить предыдущий кадр, ожидающий отправки кадр заменяется новым
+    void Send(Frame frame);
+
+    bool IsOpen() const noexcept {
+        return open_.load(std::memory_order_acquire);
+    }
+
+private:
+    void Read();
+    void OnRead(beast::error_code ec, std::size_t bytes_read);
+    void Write();
+    void OnWrite(beast::error_code ec, std::size_t bytes_written);
+
+    websocket::stream<ConnectionStream> ws_;
+    HttpRequest request_;
+    beast::flat_buffer read_buffer_;
+    // Поля ниже используются только в executor'е ws_
+    Frame writing_frame_;
+    Frame pending_frame_;
+    std::atomic<bool> open_{false};
+};
+
+// WebSocketSession хранит запрос дольше, чем живёт HTTP-сессия, поэтому запрос копируется из арены
+WebSocketSession::HttpRequest MakeWebSocketRequest(const ArenaRequest& request);
+
+// Обработчик WebSocket-запросов по умолчанию: сервер их не поддерживает
+struct RejectWebSocket {
+    void operator()(http::request<http::string_body>&& request, std::shared_ptr<WebSocketSession> ws) const {
+        http::response<http::string_body> response{http::status::not_found, request.version()};
+        response.set(http::field::content_type, "text/plain");
+        response.body() = "WebSocket is not supported";
+        response.prepare_payload();
+        ws->Reject(std::move(response));
+    }
+};
+
+// Обработчик асинхронной операции, память для которой берётся из арены соединения
+// и переиспользуется следующими операциями
+template <typename Handler>
+class ArenaBoundHandler {
+public:
+    using allocator_type = HandlerAllocator<void>;
+
+    ArenaBoundHandler(Handler handler, ConnectionArena* arena)
+        : handler_{std::move(handler)}
+        , allocator_{arena} {
+    }
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_;
+    }
+
+    const Handler& GetHandler() const noexcept {
+        return handler_;
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    Handler handler_;
+    allocator_type allocator_;
+};
+
+// Токен завершения, с которым операция размещается в памяти соединения:
+// обработчик, созданный по token, оборачивается в ArenaBoundHandler
+template <typename Token>
+struct ArenaBoundToken {
+    Token token;
+    ConnectionArena* arena;
+};
+
+template <typename Token>
+ArenaBoundToken<std::decay_t<Token>> BindArena(Token&& token, ConnectionArena* arena) {
+    return {std::forward<Token>(token), arena};
+}
+
+}  // namespace http_server
+
+namespace boost::asio {
+
+// Обработчик, обёрнутый в ArenaBoundHandler, выполняется там же, где выполнялся бы исходный
+template <typename Handler, typename Executor>
+struct associated_executor<http_server::ArenaBoundHandler<Handler>, Executor> {
+    using type = associated_executor_t<Handler, Executor>;
+
+    static type get(const http_server::ArenaBoundHandler<Handler>& handler, const Executor& executor = Executor()) noexcept {
+        return associated_executor<Handler, Executor>::get(handler.GetHandler(), executor);
+    }
+};
+
+template <typename Token, typename Signature>
+class async_result<http_server::ArenaBoundToken<Token>, Signature> {
+public:
+    template <typename Initiation, typename BoundToken, typename... Args>
+    static auto initiate(Initiation&& initiation, BoundToken&& token, Args&&... args) {
+        Token inner_token = token.token;
+        return async_initiate<Token, Signature>(
+            [initiation = std::forward<Initiation>(initiation), arena = token.arena](auto&& handler, auto&&... args) mutable {
+                std::move(initiation)(http_server::ArenaBoundHandler{std::forward<decltype(handler)>(handler), arena},
+                                      std::forward<decltype(args)>(args)...);
+            },
+            inner_token, std::forward<Args>(args)...);
+    }
+};
+
+}  // namespace boost::asio
+
+namespace http_server {
+
 class SessionBase {
     // Напишите недостающий код, используя информацию из урока
 public:
@@ -27,109 +255,362 @@ public:
     SessionBase(const SessionBase&) = delete;
     SessionBase& operator=(const SessionBase&) = delete;
     void Run();
+
+    // Сколько запросов одного соединения может ждать ответа одновременно.
+    // Пока очередь заполнена, следующий запрос из сокета не читается
+    static constexpr size_t MAX_PIPELINED_REQUESTS = 16;
 protected:
+    // Номер запроса в соединении. Ответы отправляются строго в порядке номеров,
+    // даже если обработчики завершились в другом порядке
+    using RequestId = std::uint64_t;
+
+    using HttpRequest = ArenaRequest;
+
+    // Можно вызывать из любого потока
     template <typename Body, typename Fields>
-    void Write(http::response<Body, Fields>&& response) {
-        // Запись выполняется асинхронно, поэтому response перемещаем в область кучи
-        auto safe_response = std::make_shared<http::response<Body, Fields>>(std::move(response));
-
-        auto self = GetSharedThis();
-        http::async_write(stream_, *safe_response,
-                          [safe_response, self](beast::error_code ec, std::size_t bytes_written) {
-                              self->OnWrite(safe_response->need_eof(), ec, bytes_written);
-                          });
-    }
-    explicit SessionBase(tcp::socket&& socket)
-            : stream_(std::move(socket)) {
-        }
-    using HttpRequest = http::request<http::string_body>;
+    void Write(http::response<Body, Fields>&& response, RequestId id, bool keep_alive) {
+        using Response = http::response<Body, Fields>;
+        const bool close = PrepareResponse(response, keep_alive);
+        // Запись выполняется асинхронно, поэтому response перемещаем в арену соединения
+        std::shared_ptr<void> safe_response = std::allocate_shared<Response>(ArenaAllocator<Response>{arena_}, std::move(response));
+        net::dispatch(socket_.get_executor(), ArenaBoundHandler{
+            [self = GetSharedThis(), safe_response = std::move(safe_response), id, close]() mutable {
+                self->SetResponse(id, close, std::move(safe_response), &SessionBase::WriteResponse<Response>);
+            }, arena_});
+    }
+    explicit SessionBase(ConnectionSocket&& socket);
 
-    ~SessionBase() = default;
+    ~SessionBase();
 private:
-    // tcp_stream содержит внутри себя сокет и добавляет поддержку таймаутов
-    beast::tcp_stream stream_;
-    beast::flat_buffer buffer_;
-    HttpRequest request_;
-    void OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
-        if (ec) {
-            return ReportError(ec, "write"sv);
-        }
+    // Запускает запись ответа, сохранённого в PendingResponse::response
+    using WriteFn = void (*)(SessionBase& session, const std::shared_ptr<void>& response);
 
-        if (close) {
-            // Семантика ответа требует закрыть соединение
-            return Close();
-        }
+    // Ответ, ожидающий своей очереди на отправку
+    struct PendingResponse {
+        // Пусто, пока обработчик не прислал ответ
+        std::shared_ptr<void> response;
+        WriteFn write = nullptr;
+        bool close = false;
+    };
 
-        // Считываем следующий запрос
-        Read();
-    }
-    void Read() {
-        using namespace std::literals;
-        // Очищаем запрос от прежнего значения (метод Read может быть вызван несколько раз)
-        request_ = {};
-        stream_.expires_after(30s);
-        // Считываем request_ из stream_, используя buffer_ для хранения считанных данных
-        http::async_read(stream_, buffer_, request_,
-                         // По окончании операции будет вызван метод OnRead
-                         beast::bind_front_handler(&SessionBase::OnRead, GetSharedThis()));
+    template <typename Response>
+    static void WriteResponse(SessionBase& session, const std::shared_ptr<void>& response) {
+        http::async_write(session.socket_, *static_cast<Response*>(response.get()),
+                          ArenaBoundHandler{[self = session.GetSharedThis()](beast::error_code ec, std::size_t bytes_written) {
+                              self->OnWrite(ec, bytes_written);
+                          }, session.arena_});
     }
 
-    void OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
-        using namespace std::literals;
-        if (ec == http::error::end_of_stream) {
-            // Нормальная ситуация - клиент закрыл соединение
-            return Close();
-        }
-        if (ec) {
-            return ReportError(ec, "read"sv);
-        }
-        HandleRequest(std::move(request_));
-    }
+    // Владеет ареной вместе с живыми выделениями из неё; объявлена первой, чтобы быть доступной
+    // при создании и разрушении остальных полей
+    ConnectionArena* arena_;
+    ConnectionSocket socket_;
+    beast::flat_buffer buffer_;
+    HttpRequest request_;
+    // Поля ниже используются только в executor'е socket_.
+    // Таймер ждёт не каждую операцию, а срок deadline_, который чтение и запись лишь сдвигают.
+    // Поэтому при частых запросах таймер перезапускается раз в IO_TIMEOUT, а не на каждый запрос
+    ConnectionTimer timer_;
+    std::chrono::steady_clock::time_point deadline_;
+    bool timer_waiting_ = false;
+    bool timed_out_ = false;
+    // Кольцевая очередь ответов: pending_[first_pending_id_ % MAX_PIPELINED_REQUESTS] —
+    // ответ на самый ранний запрос, на который ещё не ответили
+    std::array<PendingResponse, MAX_PIPELINED_REQUESTS> pending_;
+    size_t pending_count_ = 0;
+    RequestId first_pending_id_ = 0;
+    // Ответ, который сейчас записывается в сокет
+    std::shared_ptr<void> writing_response_;
+    bool reading_ = false;
+    bool writing_ = false;
+    // Клиент закрыл соединение или попросил закрыть его после ответа: больше не читаем
+    bool read_closed_ = false;
+    // Запрос на WebSocket, пришедший вслед за обычными; выполняется, когда все ответы отправлены
+    std::optional<HttpRequest> upgrade_request_;
 
-    void Close() {
-        beast::error_code ec;
-        stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+    PendingResponse& GetPending(RequestId id) noexcept {
+        return pending_[id % MAX_PIPELINED_REQUESTS];
     }
+    void ClearPending();
+    void SetResponse(RequestId id, bool close, std::shared_ptr<void> response, WriteFn write);
+    void OnWrite(beast::error_code ec, std::size_t bytes_written);
+    void WriteNext();
+    void ExtendDeadline();
+    void WaitTimer();
+    void OnTimer(beast::error_code ec);
+    void Read();
+    void OnRead(beast::error_code ec, std::size_t bytes_read);
+    void ContinueReading();
+    void Upgrade(HttpRequest&& request);
+    void Close();
 
-    // Обработку запроса делегируем подклассу
-    virtual void HandleRequest(HttpRequest&& request) = 0;
+    // Обработку запроса делегируем подклассу. Ответ передаётся в Write с тем же id
+    virtual void HandleRequest(HttpRequest&& request, RequestId id) = 0;
+    virtual void HandleUpgrade(WebSocketSession::HttpRequest&& request, std::shared_ptr<WebSocketSession> ws) = 0;
 
     virtual std::shared_ptr<SessionBase> GetSharedThis() = 0;
 };
 
-template <typename RequestHandler>
-class Session : public SessionBase, public std::enable_shared_from_this<Session<RequestHandler>> {
+template <typename RequestHandler, typename WebSocketHandler = RejectWebSocket>
+class Session : public SessionBase, public std::enable_shared_from_this<Session<RequestHandler, WebSocketHandler>> {
 	// Напишите недостающий код, используя информацию из урока
 public:
-    template <typename Handler>
-    Session(tcp::socket&& socket, Handler&& request_handler)
+    template <typename Handler, typename WsHandler>
+    Session(ConnectionSocket&& socket, Handler&& request_handler, WsHandler&& ws_handler)
         : SessionBase(std::move(socket))
-        , request_handler_(std::forward<Handler>(request_handler)) {
+        , request_handler_(std::forward<Handler>(request_handler))
+        , ws_handler_(std::forward<WsHandler>(ws_handler)) {
     }
 private:
-    void HandleRequest(HttpRequest&& request) override {
+    void HandleRequest(HttpRequest&& request, RequestId id) override {
+        const bool keep_alive = request.keep_alive();
         // Захватываем умный указатель на текущий объект Session в лямбде,
         // чтобы продлить время жизни сессии до вызова лямбды.
         // Используется generic-лямбда функция, способная принять response произвольного типа
-        request_handler_(std::move(request), [self = this->shared_from_this()](auto&& response) {
-            self->Write(std::move(response));
+        request_handler_(std::move(request), [self = this->shared_from_this(), id, keep_alive](auto&& response) {
+            self->Write(std::move(response), id, keep_alive);
         });
     }
+    // Обработчик решает, принять подключение (ws->Accept) или отказать (ws->Reject)
+    void HandleUpgrade(WebSocketSession::HttpRequest&& request, std::shared_ptr<WebSocketSession> ws) override {
+        ws_handler_(std::move(request), std::move(ws));
+    }
     RequestHandler request_handler_;
+    WebSocketHandler ws_handler_;
     std::shared_ptr<SessionBase> GetSharedThis() override {
         return this->shared_from_this();
     }    
 };
 
-template <typename RequestHandler>
-class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
+// Сопрограммы соединения выполняются в его strand'е. С конкретным типом executor'а,
+// как и в Session, операции не выделяют память под any_io_executor
+template <typename T = void>
+using ConnectionAwaitable = net::awaitable<T, ConnectionExecutor>;
+inline constexpr net::use_awaitable_t<ConnectionExecutor> CONNECTION_AWAITABLE{};
+
+// Место под ответ обработчика в кадре сопрограммы. Тип ответа заранее неизвестен,
+// поэтому ответ создаётся во встроенном буфере, а разрушается через указатель на функцию
+class ResponseSlot {
+public:
+    static constexpr size_t CAPACITY = 512;
+
+    ResponseSlot() = default;
+    ResponseSlot(const ResponseSlot&) = delete;
+    ResponseSlot& operator=(const ResponseSlot&) = delete;
+
+    ~ResponseSlot() {
+        Reset();
+    }
+
+    template <typename Body, typename Fields>
+    http::response<Body, Fields>& Emplace(http::response<Body, Fields>&& response, bool keep_alive) {
+        using Response = http::response<Body, Fields>;
+        static_assert(sizeof(Response) <= CAPACITY && alignof(Response) <= alignof(std::max_align_t),
+                      "Response does not fit into ResponseSlot");
+        Reset();
+        close_ = PrepareResponse(response, keep_alive);
+        auto* stored = new (storage_) Response(std::move(response));
+        destroy_ = [](void* response) {
+            static_cast<Response*>(response)->~Response();
+        };
+        return *stored;
+    }
+
+    // Семантика ответа требует закрыть соединение после его отправки
+    bool NeedClose() const noexcept {
+        return close_;
+    }
+
+    void Reset() noexcept {
+        if (destroy_) {
+            destroy_(storage_);
+            destroy_ = nullptr;
+        }
+    }
+
+private:
+    using DestroyFn = void (*)(void* response);
+
+    alignas(std::max_align_t) unsigned char storage_[CAPACITY];
+    DestroyFn destroy_ = nullptr;
+    bool close_ = false;
+};
+
+// Состояние соединения, общее для сопрограммы сессии и сторожа таймаута (WatchDeadline)
+class CoroutineConnection {
+public:
+    explicit CoroutineConnection(ConnectionSocket&& socket);
+    CoroutineConnection(const CoroutineConnection&) = delete;
+    CoroutineConnection& operator=(const CoroutineConnection&) = delete;
+    ~CoroutineConnection();
+
+    ConnectionArena* GetArena() const noexcept {
+        return arena_;
+    }
+
+    ConnectionSocket& GetSocket() noexcept {
+        return socket_;
+    }
+
+    // Чтение или запись должны завершиться за IO_TIMEOUT
+    void ExtendDeadline() noexcept {
+        deadline_ = std::chrono::steady_clock::now() + IO_TIMEOUT;
+    }
+
+    // Пока запрос у обработчика, таймаут не действует
+    void SetHandling(bool handling) noexcept {
+        handling_ = handling;
+    }
+
+    bool IsTimedOut() const noexcept {
+        return timed_out_;
+    }
+
+    // Останавливает сторожа таймаута; сокет остаётся открытым (например, для WebSocket)
+    void Stop();
+    // Закрывает соединение на запись и останавливает сторожа таймаута
+    void Close();
+    // То же из любого потока: закрытие выполняется в strand'е соединения
+    static void Close(std::shared_ptr<CoroutineConnection> connection);
+
+    // Сторож таймаута: прерывает операции с сокетом, если срок истёк
+    static ConnectionAwaitable<> WatchDeadline(std::shared_ptr<CoroutineConnection> connection);
+
+private:
+    ConnectionArena* arena_;
+    ConnectionSocket socket_;
+    ConnectionTimer timer_;
+    std::chrono::steady_clock::time_point deadline_;
+    bool handling_ = false;
+    bool timed_out_ = false;
+    bool stopped_ = false;
+};
+
+// Закрывает соединение при любом выходе из сопрограммы сессии, в том числе когда её кадр
+// разрушается без возобновления: так бывает, если обработчик уничтожил send, не вызвав его.
+// Иначе сторож таймаута продлевал бы срок, пока запрос у обработчика, и держал соединение вечно
+class CoroutineConnectionCloser {
+public:
+    explicit CoroutineConnectionCloser(std::shared_ptr<CoroutineConnection> connection) noexcept
+        : connection_{std::move(connection)} {
+    }
+
+    CoroutineConnectionCloser(const CoroutineConnectionCloser&) = delete;
+    CoroutineConnectionCloser& operator=(const CoroutineConnectionCloser&) = delete;
+
+    ~CoroutineConnectionCloser() {
+        if (connection_) {
+            CoroutineConnection::Close(std::move(connection_));
+        }
+    }
+
+    // Соединение передано другому владельцу (WebSocketSession) и закрываться не должно
+    void Release() noexcept {
+        connection_.reset();
+    }
+
+private:
+    std::shared_ptr<CoroutineConnection> connection_;
+};
+
+// Передаёт запрос обработчику и записывает его ответ, сохранённый в slot. Операция завершается,
+// когда ответ отправлен. Ответ может прийти из любого потока; запись начинается в strand'е соединения.
+// Ожидание ответа и запись — одна операция, чтобы на запрос приходилось меньше кадров сопрограмм
+template <typename RequestHandler, typename CompletionToken>
+auto AsyncHandleRequest(CoroutineConnection& connection, RequestHandler& request_handler, ArenaRequest&& request, ResponseSlot& slot,
+                        CompletionToken&& token) {
+    return net::async_initiate<CompletionToken, void(beast::error_code, std::size_t)>(
+        [&connection, &request_handler, &slot](auto handler, ArenaRequest&& request) {
+            const bool keep_alive = request.keep_alive();
+            connection.SetHandling(true);
+            request_handler(std::move(request), [&connection, &slot, keep_alive, handler = std::move(handler)](auto&& response) mutable {
+                auto& stored = slot.Emplace(std::move(response), keep_alive);
+                net::dispatch(connection.GetSocket().get_executor(), ArenaBoundHandler{
+                    [&connection, &stored, handler = std::move(handler)]() mutable {
+                        connection.SetHandling(false);
+                        connection.ExtendDeadline();
+                        http::async_write(connection.GetSocket(), stored, std::move(handler));
+                    }, connection.GetArena()});
+            });
+        },
+        token, std::move(request));
+}
+
+// Сессия на сопрограммах: запрос читается, передаётся обработчику и ответ записывается
+// последовательно, без enable_shared_from_this и без выделения памяти под каждый ответ.
+// Запрос и ответ живут в кадре сопрограммы. Конвейерные запросы обрабатываются по одному:
+// следующий разбирается из буфера после отправки ответа на предыдущий
+template <typename RequestHandler, typename WebSocketHandler>
+ConnectionAwaitable<> RunCoroutineSession(std::shared_ptr<CoroutineConnection> connection, RequestHandler request_handler,
+                                          WebSocketHandler ws_handler) {
+    ConnectionArena* const arena = connection->GetArena();
+    CoroutineConnectionCloser closer{connection};
+    beast::flat_buffer buffer;
+    ResponseSlot response;
+    for (;;) {
+        // Ответ отправлен, запрос обработчику больше не нужен: память арены используется заново
+        arena->TryReset();
+        ArenaRequest request = MakeArenaRequest(arena);
+        beast::error_code ec;
+        connection->ExtendDeadline();
+        co_await http::async_read(connection->GetSocket(), buffer, request,
+                                  BindArena(net::redirect_error(CONNECTION_AWAITABLE, ec), arena));
+        if (ec) {
+            // Клиент закрыл соединение или долго молчал — нормальная ситуация
+            if (ec != http::error::end_of_stream && !connection->IsTimedOut()) {
+                ReportError(ec, "read"sv);
+            }
+            break;
+        }
+        if (websocket::is_upgrade(request)) {
+            // Дальше соединением владеет WebSocketSession
+            connection->Stop();
+            closer.Release();
+            ws_handler(MakeWebSocketRequest(request), std::make_shared<WebSocketSession>(std::move(connection->GetSocket())));
+            co_return;
+        }
+        co_await AsyncHandleRequest(*connection, request_handler, std::move(request), response,
+                                    BindArena(net::redirect_error(CONNECTION_AWAITABLE, ec), arena));
+        const bool close = response.NeedClose();
+        response.Reset();
+        if (ec) {
+            ReportError(ec, "write"sv);
+            break;
+        }
+        if (close) {
+            break;
+        }
+    }
+}
+
+// Сообщает об исключении, с которым завершилась сопрограмма соединения
+void ReportException(std::exception_ptr exception);
+
+template <typename RequestHandler, typename WebSocketHandler>
+void RunCoroutineSession(ConnectionSocket&& socket, const RequestHandler& request_handler, const WebSocketHandler& ws_handler) {
+    const auto executor = socket.get_executor();
+    auto connection = std::make_shared<CoroutineConnection>(std::move(socket));
+    net::co_spawn(executor, CoroutineConnection::WatchDeadline(connection), ReportException);
+    net::co_spawn(executor, RunCoroutineSession(std::move(connection), request_handler, ws_handler), ReportException);
+}
+
+#ifdef SO_REUSEPORT
+// Несколько сокетов с этим флагом могут слушать один порт; ядро распределяет между ними соединения
+using reuse_port = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+template <typename RequestHandler, typename WebSocketHandler = RejectWebSocket>
+class Listener : public std::enable_shared_from_this<Listener<RequestHandler, WebSocketHandler>> {
 public:
-    template <typename Handler>
-    Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Handler&& request_handler)
+    template <typename Handler, typename WsHandler = WebSocketHandler>
+    Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Handler&& request_handler, WsHandler&& ws_handler = {},
+             bool reuse_port = false, SessionModel session_model = SessionModel::CALLBACKS)
         : ioc_(ioc)
         // Обработчики асинхронных операций acceptor_ будут вызываться в своём strand
         , acceptor_(net::make_strand(ioc))
-        , request_handler_(std::forward<Handler>(request_handler)) {
+        , request_handler_(std::forward<Handler>(request_handler))
+        , ws_handler_(std::forward<WsHandler>(ws_handler))
+        , session_model_(session_model) {
         // Открываем acceptor, используя протокол (IPv4 или IPv6), указанный в endpoint
         acceptor_.open(endpoint.protocol());
 
@@ -138,6 +619,13 @@ public:
         // Однако это может помешать повторно открыть сокет в полузакрытом состоянии.
         // Флаг reuse_address разрешает открыть сокет, когда он "наполовину закрыт"
         acceptor_.set_option(net::socket_base::reuse_address(true));
+        if (reuse_port) {
+#ifdef SO_REUSEPORT
+            acceptor_.set_option(http_server::reuse_port(true));
+#else
+            throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
+        }
         // Привязываем acceptor к адресу и порту endpoint
         acceptor_.bind(endpoint);
         // Переводим acceptor в состояние, в котором он способен принимать новые соединения
@@ -151,6 +639,8 @@ private:
     net::io_context& ioc_;
     tcp::acceptor acceptor_{net::make_strand(ioc_)};
     RequestHandler request_handler_;
+    WebSocketHandler ws_handler_;
+    SessionModel session_model_;
     
     void DoAccept() {
         acceptor_.async_accept(
@@ -167,13 +657,19 @@ private:
             // std::bind(&Listener::OnAccept, this->shared_from_this(), ph::_1, ph::_2)
             beast::bind_front_handler(&Listener::OnAccept, this->shared_from_this()));
     }
-    void OnAccept(sys::error_code ec, tcp::socket socket) {
+    void OnAccept(sys::error_code ec, ConnectionSocket socket) {
         using namespace std::literals;
 
         if (ec) {
             return ReportError(ec, "accept"sv);
         }
 
+        // Ответы на конвейерные запросы уходят несколькими короткими записями подряд.
+        // С алгоритмом Нейгла каждая следующая ждала бы подтверждения предыдущей,
+        // а клиент откладывает подтверждение на десятки миллисекунд
+        sys::error_code ignored;
+        socket.set_option(tcp::no_delay(true), ignored);
+
         // Асинхронно обрабатываем сессию
         AsyncRunSession(std::move(socket));
 
@@ -181,8 +677,11 @@ private:
         DoAccept();
     }
 
-    void AsyncRunSession(tcp::socket&& socket) {
-        std::make_shared<Session<RequestHandler>>(std::move(socket), request_handler_)->Run();
+    void AsyncRunSession(ConnectionSocket&& socket) {
+        if (session_model_ == SessionModel::COROUTINES) {
+            return RunCoroutineSession(std::move(socket), request_handler_, ws_handler_);
+        }
+        std::make_shared<Session<RequestHandler, WebSocketHandler>>(std::move(socket), request_handler_, ws_handler_)->Run();
     }
 };
 
@@ -195,4 +694,25 @@ void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandl
     std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler))->Run();
 }
 
+// То же, но запросы на WebSocket-подключение передаются в ws_handler(request, ws)
+template <typename RequestHandler, typename WebSocketHandler>
+void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler, WebSocketHandler&& ws_handler,
+               SessionModel session_model = SessionModel::CALLBACKS) {
+    using MyListener = Listener<std::decay_t<RequestHandler>, std::decay_t<WebSocketHandler>>;
+
+    std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler),
+                                 std::forward<WebSocketHandler>(ws_handler), false, session_model)->Run();
+}
+
+// Как ServeHttp, но прослушивающий сокет открывается с SO_REUSEPORT. Вызывается для каждого
+// из нескольких io_context с одним и тем же endpoint: у каждого будет свой сокет и своя очередь соединений
+template <typename RequestHandler, typename WebSocketHandler = RejectWebSocket>
+void ServeHttpReusePort(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler, WebSocketHandler&& ws_handler = {},
+                        SessionModel session_model = SessionModel::CALLBACKS) {
+    using MyListener = Listener<std::decay_t<RequestHandler>, std::decay_t<WebSocketHandler>>;
+
+    std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler),
+                                 std::forward<WebSocketHandler>(ws_handler), true, session_model)->Run();
+}
+
 }  // namespace http_server
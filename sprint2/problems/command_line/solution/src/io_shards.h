@@ -0,0 +1,95 @@
+#pragma once
+#include "sdk.h"
+
+#include <boost/asio/io_context.hpp>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace io_shards {
+
+namespace net = boost::asio;
+
+/**
+ * Набор io_context, каждый из которых выполняется ровно в одном потоке.
+ * В таком io_context операции не конкурируют за общую очередь завершений,
+ * а обработчики одного соединения всегда выполняются на одном ядре.
+ * Работа с общими данными передаётся в их executor'ы через post/dispatch.
+ */
+class IoShards {
+public:
+    explicit IoShards(unsigned count) {
+        shards_.reserve(count);
+        for (unsigned i = 0; i < count; ++i) {
+            // Подсказка 1 говорит io_context, что его выполняет один поток, и он не будит
+            // другие потоки при появлении работы. Внутренние блокировки при этом остаются:
+            // strand'ы игровых сессий из других потоков отправляют сюда завершения записи
+            // ответов. BOOST_ASIO_CONCURRENCY_HINT_UNSAFE, который их отключает, здесь использовать нельзя
+            shards_.push_back(std::make_unique<net::io_context>(1));
+        }
+    }
+
+    IoShards(const IoShards&) = delete;
+    IoShards& operator=(const IoShards&) = delete;
+
+    ~IoShards() {
+        Stop();
+        Join();
+    }
+
+    size_t Size() const noexcept {
+        return shards_.size();
+    }
+
+    net::io_context& GetShard(size_t index) noexcept {
+        return *shards_[index];
+    }
+
+    // Запускает по потоку на каждый io_context. Поток i закрепляется за ядром i,
+    // если ядер меньше, чем потоков, — по кругу
+    void Run() {
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            threads_.emplace_back([this, i, core = static_cast<unsigned>(i % cores)] {
+                PinCurrentThread(core);
+                shards_[i]->run();
+            });
+        }
+    }
+
+    void Stop() {
+        for (auto& shard : shards_) {
+            shard->stop();
+        }
+    }
+
+    void Join() {
+        for (auto& thread : threads_) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+        threads_.clear();
+    }
+
+private:
+    static void PinCurrentThread([[maybe_unused]] unsigned core) {
+#ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core, &cpus);
+        // Не удалось закрепить (например, ядро недоступно в cgroup) — поток просто работает без привязки
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+    }
+
+    std::vector<std::unique_ptr<net::io_context>> shards_;
+    std::vector<std::thread> threads_;
+};
+
+}  // namespace io_shards
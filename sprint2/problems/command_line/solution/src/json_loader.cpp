@@ -78,6 +78,8 @@ model::Game LoadGame(const std::filesystem::path& json_path) {
                     model::Road road = ParseRoadFromJson(road_obj);
                     map.AddRoad(road);
                 }
+                // Карта после загрузки не меняется, поэтому граф дорог строим один раз
+                map.BuildRoadGraph();
             }
             if (json_map_object.contains("buildings")){
                 json::array json_buildings = json_map_object["buildings"].as_array();
@@ -0,0 +1,190 @@
+#pragma once
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace json_writer {
+
+/**
+ * Потоковая запись JSON прямо в строку, без построения дерева boost::json.
+ * Запятые между элементами расставляются автоматически:
+ *
+ *  std::string out;
+ *  json_writer::JsonWriter writer{out};
+ *  writer.BeginObject().Key("pos").BeginArray().Double(1.5).Double(2).EndArray().EndObject();
+ *  // out == R"({"pos":[1.5,2]})"
+ *
+ * Корректность вложенности не проверяется — за неё отвечает вызывающий код.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) noexcept
+        : out_{out} {
+    }
+
+    JsonWriter& BeginObject() {
+        BeforeValue();
+        out_ += '{';
+        need_comma_ = false;
+        return *this;
+    }
+    JsonWriter& EndObject() {
+        out_ += '}';
+        need_comma_ = true;
+        return *this;
+    }
+    JsonWriter& BeginArray() {
+        BeforeValue();
+        out_ += '[';
+        need_comma_ = false;
+        return *this;
+    }
+    JsonWriter& EndArray() {
+        out_ += ']';
+        need_comma_ = true;
+        return *this;
+    }
+
+    JsonWriter& Key(std::string_view key) {
+        BeforeValue();
+        WriteEscaped(key);
+        out_ += ':';
+        need_comma_ = false;
+        return *this;
+    }
+
+    JsonWriter& String(std::string_view value) {
+        BeforeValue();
+        WriteEscaped(value);
+        return *this;
+    }
+
+    JsonWriter& Bool(bool value) {
+        BeforeValue();
+        out_ += value ? "true" : "false";
+        return *this;
+    }
+
+    JsonWriter& Int(int64_t value) {
+        BeforeValue();
+        AppendInteger(value);
+        return *this;
+    }
+
+    // Кратчайшая запись, из которой читается то же самое число (std::to_chars в libstdc++
+    // реализован по алгоритму Ryu). Целые значения, частые у координат и скоростей,
+    // пишутся как целые без обращения к нему.
+    // В JSON нет NaN и бесконечностей, вместо них пишется null
+    JsonWriter& Double(double value) {
+        BeforeValue();
+        WriteDouble(value);
+        return *this;
+    }
+
+    // Значение, округлённое до decimals знаков после запятой (0..MAX_DECIMALS),
+    // без завершающих нулей. Форматируется целочисленной арифметикой
+    JsonWriter& Fixed(double value, int decimals) {
+        BeforeValue();
+        const double scaled = std::round(value * POWERS_OF_TEN[decimals]);
+        if (!std::isfinite(scaled) || std::fabs(scaled) >= MAX_EXACT_INTEGER) {
+            WriteDouble(value);
+            return *this;
+        }
+        auto units = static_cast<int64_t>(scaled);
+        if (units < 0) {
+            out_ += '-';
+            units = -units;
+        }
+        const auto divisor = static_cast<int64_t>(POWERS_OF_TEN[decimals]);
+        AppendInteger(units / divisor);
+        int64_t fraction = units % divisor;
+        if (fraction != 0) {
+            // Завершающие нули дробной части не пишем
+            int digits = decimals;
+            while (fraction % 10 == 0) {
+                fraction /= 10;
+                --digits;
+            }
+            char buffer[MAX_DECIMALS + 1];
+            buffer[0] = '.';
+            for (int i = digits; i > 0; --i) {
+                buffer[i] = static_cast<char>('0' + fraction % 10);
+                fraction /= 10;
+            }
+            out_.append(buffer, digits + 1);
+        }
+        return *this;
+    }
+
+    static constexpr int MAX_DECIMALS = 9;
+
+private:
+    // Все целые по модулю меньше 2^53 представимы в double точно
+    static constexpr double MAX_EXACT_INTEGER = 9007199254740992.0;
+    static constexpr double POWERS_OF_TEN[MAX_DECIMALS + 1] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+    void AppendInteger(int64_t value) {
+        char buffer[24];
+        const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out_.append(buffer, result.ptr);
+    }
+
+    void WriteDouble(double value) {
+        if (!std::isfinite(value)) {
+            out_ += "null";
+            return;
+        }
+        if (std::trunc(value) == value && std::fabs(value) < MAX_EXACT_INTEGER && !(value == 0 && std::signbit(value))) {
+            AppendInteger(static_cast<int64_t>(value));
+            return;
+        }
+        char buffer[32];
+        const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out_.append(buffer, result.ptr);
+    }
+
+    void BeforeValue() {
+        if (need_comma_) {
+            out_ += ',';
+        }
+        need_comma_ = true;
+    }
+
+    void WriteEscaped(std::string_view value) {
+        static constexpr char HEX_CHARS[] = "0123456789abcdef";
+        out_ += '"';
+        // Символы, не требующие экранирования, копируются кусками
+        size_t plain_begin = 0;
+        for (size_t i = 0; i < value.size(); ++i) {
+            const auto c = static_cast<unsigned char>(value[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            out_.append(value.data() + plain_begin, i - plain_begin);
+            plain_begin = i + 1;
+            switch (c) {
+                case '"': out_ += "\\\""; break;
+                case '\\': out_ += "\\\\"; break;
+                case '\b': out_ += "\\b"; break;
+                case '\f': out_ += "\\f"; break;
+                case '\n': out_ += "\\n"; break;
+                case '\r': out_ += "\\r"; break;
+                case '\t': out_ += "\\t"; break;
+                default:
+                    out_ += "\\u00";
+                    out_ += HEX_CHARS[c >> 4];
+                    out_ += HEX_CHARS[c & 0xF];
+            }
+        }
+        out_.append(value.data() + plain_begin, value.size() - plain_begin);
+        out_ += '"';
+    }
+
+    std::string& out_;
+    bool need_comma_ = false;
+};
+
+}  // namespace json_writer
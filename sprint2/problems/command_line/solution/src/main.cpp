@@ -9,6 +9,7 @@
 #include <cassert>
 #include "json_loader.h"
 #include "request_handler.h"
+#include "io_shards.h"
 #include <optional>
 
 
@@ -91,6 +92,9 @@ struct Args {
     std::string www_root;
     bool randomize_spawn_points = false;
     bool have_tick_period = false;
+    std::optional<int> state_coord_decimals;
+    unsigned io_shards = 0;
+    http_server::SessionModel session_model = http_server::SessionModel::CALLBACKS;
 }; 
 [[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
     namespace po = boost::program_options;
@@ -102,7 +106,10 @@ struct Args {
         ("tick-period,t", po::value<std::string>(), "Set tick period (milliseconds)")
         ("config-file,c", po::value<std::string>(), "Set config file path")
         ("www-root,w", po::value<std::string>(), "Set static files root")
-        ("randomize-spawn-points", "Spawn dogs at random positions");
+        ("randomize-spawn-points", "Spawn dogs at random positions")
+        ("state-coord-decimals", po::value<int>(), "Round dog coordinates in game state responses to this number of decimals (0-9)")
+        ("io-shards", po::value<unsigned>(), "Accept and serve connections on this many single-threaded io_contexts with SO_REUSEPORT listeners (0 - one shared io_context)")
+        ("session-model", po::value<std::string>(), "Serve HTTP connections with callback chains or C++20 coroutines (callbacks|coroutines)");
     po::variables_map vm;
     try {
         po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -131,6 +138,26 @@ struct Args {
         if (vm.count("randomize-spawn-points")) {
             args.randomize_spawn_points = true;
         }
+        if (vm.count("state-coord-decimals")) {
+            const int decimals = vm["state-coord-decimals"].as<int>();
+            if (decimals < 0 || decimals > json_writer::JsonWriter::MAX_DECIMALS) {
+                std::cerr << "Invalid state coordinate decimals provided: " << decimals << "\n";
+                return std::nullopt;
+            }
+            args.state_coord_decimals = decimals;
+        }
+        if (vm.count("io-shards")) {
+            args.io_shards = vm["io-shards"].as<unsigned>();
+        }
+        if (vm.count("session-model")) {
+            const std::string session_model = vm["session-model"].as<std::string>();
+            if (session_model == "coroutines"sv) {
+                args.session_model = http_server::SessionModel::COROUTINES;
+            } else if (session_model != "callbacks"sv) {
+                std::cerr << "Invalid session model provided: " << session_model << "\n";
+                return std::nullopt;
+            }
+        }
         return args;
     } catch (const po::error &ex) {
         std::cerr << "Error: " << ex.what() << "\n";
@@ -158,17 +185,22 @@ int main(int argc, const char* argv[]) {
         const unsigned num_threads = std::thread::hardware_concurrency();
         net::io_context ioc(num_threads);
 
+        // В режиме с шардами соединения обслуживаются в отдельных однопоточных io_context,
+        // а ioc выполняет только игровые strand'ы и таймер тиков
+        io_shards::IoShards shards{options->io_shards};
+
         // 3. Добавляем асинхронный обработчик сигналов SIGINT и SIGTERM
         net::signal_set signals(ioc, SIGINT, SIGTERM);
-        signals.async_wait([&ioc](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
+        signals.async_wait([&ioc, &shards](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
             if (!ec) {
                 ioc.stop();
+                shards.Stop();
             }
         });
         boost::asio::strand<boost::asio::io_context::executor_type> strand(ioc.get_executor());
         
         // 4. Создаём обработчик HTTP-запросов и связываем его с моделью игры
-        http_handler::RequestHandler handler{game,static_files_root,options->randomize_spawn_points,strand};
+        http_handler::RequestHandler handler{game,static_files_root,options->randomize_spawn_points,strand,options->state_coord_decimals};
         std::chrono::milliseconds delta_ms = options->tick_period;
         if (options->have_tick_period){
             std::cout << "Using tick period:  "<< delta_ms.count() << std::endl;
@@ -180,17 +212,35 @@ int main(int argc, const char* argv[]) {
         // 5. Запустить обработчик HTTP-запросов, делегируя их обработчику запросов
         const auto address = net::ip::make_address("0.0.0.0");
         constexpr net::ip::port_type port = 8080;
-        http_server::ServeHttp(ioc, {address, port}, [&handler](auto&& req, auto&& send) {
+        auto request_handler = [&handler](auto&& req, auto&& send) {
             handler(std::forward<decltype(req)>(req), std::forward<decltype(send)>(send));
-        });
+        };
+        auto ws_handler = [&handler](auto&& req, auto ws) {
+            handler.HandleWebSocket(std::forward<decltype(req)>(req), std::move(ws));
+        };
+        if (shards.Size() == 0) {
+            http_server::ServeHttp(ioc, {address, port}, request_handler, ws_handler, options->session_model);
+        } else {
+            // Ответы из игровых strand'ов возвращаются в io_context соединения через его executor
+            for (size_t i = 0; i < shards.Size(); ++i) {
+                http_server::ServeHttpReusePort(shards.GetShard(i), {address, port}, request_handler, ws_handler,
+                                                options->session_model);
+            }
+            shards.Run();
+        }
         
         // Эта надпись сообщает тестам о том, что сервер запущен и готов обрабатывать запросы
         std::cout << "Server has started..."sv << std::endl;
 
         // 6. Запускаем обработку асинхронных операций
-        RunWorkers(std::max(1u, num_threads), [&ioc] {
+        // Ядра, занятые шардами, игровым потокам не отдаём
+        const unsigned game_threads = num_threads > shards.Size() ? num_threads - static_cast<unsigned>(shards.Size()) : 1u;
+        RunWorkers(std::max(1u, game_threads), [&ioc] {
             ioc.run();
         });
+        // Потоки шардов обращаются к handler, поэтому завершаем их до его разрушения
+        shards.Stop();
+        shards.Join();
     } catch (const std::exception& ex) {
         std::cerr << ex.what() << std::endl;
         return EXIT_FAILURE;
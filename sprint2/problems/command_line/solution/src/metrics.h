@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace metrics {
+
+// Накопительная статистика длительностей операции: количество, сумма и максимум.
+// Обновляется из разных потоков без блокировок
+class LatencyStats {
+public:
+    void Add(std::chrono::nanoseconds duration) noexcept {
+        const auto ns = static_cast<std::uint64_t>(duration.count());
+        count_.fetch_add(1, std::memory_order_relaxed);
+        total_ns_.fetch_add(ns, std::memory_order_relaxed);
+        for (auto max = max_ns_.load(std::memory_order_relaxed);
+             ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed);) {
+        }
+    }
+
+    std::uint64_t GetCount() const noexcept {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    double GetAverageUs() const noexcept {
+        const auto count = GetCount();
+        return count ? total_ns_.load(std::memory_order_relaxed) / 1000.0 / count : 0.0;
+    }
+
+    double GetMaxUs() const noexcept {
+        return max_ns_.load(std::memory_order_relaxed) / 1000.0;
+    }
+
+private:
+    std::atomic<std::uint64_t> count_{0};
+    std::atomic<std::uint64_t> total_ns_{0};
+    std::atomic<std::uint64_t> max_ns_{0};
+};
+
+// Добавляет в stats время от создания до разрушения объекта
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyStats& stats) noexcept
+        : stats_{stats} {
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer() {
+        stats_.Add(std::chrono::steady_clock::now() - start_);
+    }
+
+private:
+    LatencyStats& stats_;
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+};
+
+}  // namespace metrics
@@ -1,6 +1,12 @@
 #include "model.h"
 
 #include <stdexcept>
+#include <algorithm>
+#include <tuple>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 namespace model {
 using namespace std::literals;
@@ -21,6 +27,247 @@ void Map::AddOffice(Office office) {
     }
 }
 
+std::uint64_t Map::RoadGridKey(Coord x, Coord y) noexcept {
+    // Отрицательные координаты тоже допустимы, поэтому делим с округлением вниз
+    auto cell = [](Coord c) {
+        return static_cast<std::uint32_t>(c >= 0 ? c / ROAD_GRID_CELL_SIZE
+                                                 : (c - ROAD_GRID_CELL_SIZE + 1) / ROAD_GRID_CELL_SIZE);
+    };
+    return (static_cast<std::uint64_t>(cell(x)) << 32) | cell(y);
+}
+
+void Map::IndexRoad(size_t index) {
+    // Любая точка дороги (с учётом её ширины 0.4 < 0.5) после округления
+    // попадает в целочисленную точку осевой линии дороги, поэтому достаточно
+    // зарегистрировать дорогу во всех ячейках, через которые проходит её ось
+    const Road& road = roads_[index];
+    const Coord min_x = std::min(road.GetStart().x, road.GetEnd().x);
+    const Coord max_x = std::max(road.GetStart().x, road.GetEnd().x);
+    const Coord min_y = std::min(road.GetStart().y, road.GetEnd().y);
+    const Coord max_y = std::max(road.GetStart().y, road.GetEnd().y);
+
+    std::uint64_t last_key = RoadGridKey(min_x, min_y);
+    road_grid_[last_key].push_back(index);
+    for (Coord x = min_x; x <= max_x; ++x) {
+        for (Coord y = min_y; y <= max_y; ++y) {
+            if (auto key = RoadGridKey(x, y); key != last_key) {
+                road_grid_[key].push_back(index);
+                last_key = key;
+            }
+        }
+    }
+}
+
+bool Map::ContainsPoint(const Road& road, const Coordinate& coordinate) noexcept {
+    const double min_x = std::min(road.GetStart().x, road.GetEnd().x) - ROAD_HALF_WIDTH;
+    const double max_x = std::max(road.GetStart().x, road.GetEnd().x) + ROAD_HALF_WIDTH;
+    const double min_y = std::min(road.GetStart().y, road.GetEnd().y) - ROAD_HALF_WIDTH;
+    const double max_y = std::max(road.GetStart().y, road.GetEnd().y) + ROAD_HALF_WIDTH;
+    return coordinate.x >= min_x && coordinate.x <= max_x &&
+           coordinate.y >= min_y && coordinate.y <= max_y;
+}
+
+const Road* Map::FindRoad(const Coordinate& coordinate) const noexcept {
+    const Coord x = static_cast<Coord>(std::lround(coordinate.x));
+    const Coord y = static_cast<Coord>(std::lround(coordinate.y));
+    auto it = road_grid_.find(RoadGridKey(x, y));
+    if (it == road_grid_.end()) {
+        return nullptr;
+    }
+    // Индексы в ячейке упорядочены по возрастанию, поэтому первая подходящая
+    // дорога совпадает с той, что нашёл бы линейный перебор
+    for (size_t index : it->second) {
+        if (ContainsPoint(roads_[index], coordinate)) {
+            return &roads_[index];
+        }
+    }
+    return nullptr;
+}
+
+void Map::BuildRoadGraph() {
+    // Группируем дороги по ориентации и оси, внутри группы сортируем по началу
+    auto axis = [](const Road& road) {
+        return road.IsHorizontal() ? road.GetStart().y : road.GetStart().x;
+    };
+    auto begin = [](const Road& road) {
+        return road.IsHorizontal() ? std::min(road.GetStart().x, road.GetEnd().x)
+                                   : std::min(road.GetStart().y, road.GetEnd().y);
+    };
+    auto end = [](const Road& road) {
+        return road.IsHorizontal() ? std::max(road.GetStart().x, road.GetEnd().x)
+                                   : std::max(road.GetStart().y, road.GetEnd().y);
+    };
+    std::vector<size_t> order(roads_.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        const Road& l = roads_[lhs];
+        const Road& r = roads_[rhs];
+        return std::tuple{!l.IsHorizontal(), axis(l), begin(l)} < std::tuple{!r.IsHorizontal(), axis(r), begin(r)};
+    });
+
+    corridors_.clear();
+    road_to_corridor_.assign(roads_.size(), 0);
+    const Road* prev = nullptr;
+    for (size_t index : order) {
+        const Road& road = roads_[index];
+        // Дороги, которые перекрываются или касаются концами, образуют один коридор
+        if (prev && prev->IsHorizontal() == road.IsHorizontal() && axis(*prev) == axis(road) &&
+            begin(road) <= corridors_.back().end) {
+            corridors_.back().end = std::max(corridors_.back().end, end(road));
+        } else {
+            corridors_.push_back({begin(road), end(road)});
+        }
+        road_to_corridor_[index] = corridors_.size() - 1;
+        prev = &road;
+    }
+}
+
+std::optional<std::pair<double, double>> Map::GetMoveRange(const Coordinate& coordinate, bool horizontal) const noexcept {
+    const Coord x = static_cast<Coord>(std::lround(coordinate.x));
+    const Coord y = static_cast<Coord>(std::lround(coordinate.y));
+    auto it = road_grid_.find(RoadGridKey(x, y));
+    if (it == road_grid_.end()) {
+        return std::nullopt;
+    }
+    const bool graph_built = road_to_corridor_.size() == roads_.size();
+    const Road* across = nullptr;
+    for (size_t index : it->second) {
+        const Road& road = roads_[index];
+        if (!ContainsPoint(road, coordinate)) {
+            continue;
+        }
+        if (road.IsHorizontal() == horizontal) {
+            // Вдоль дороги можно двигаться до концов её коридора
+            Coord begin = horizontal ? std::min(road.GetStart().x, road.GetEnd().x)
+                                     : std::min(road.GetStart().y, road.GetEnd().y);
+            Coord end = horizontal ? std::max(road.GetStart().x, road.GetEnd().x)
+                                   : std::max(road.GetStart().y, road.GetEnd().y);
+            if (graph_built) {
+                const Corridor& corridor = corridors_[road_to_corridor_[index]];
+                begin = corridor.begin;
+                end = corridor.end;
+            }
+            return std::pair{begin - ROAD_HALF_WIDTH, end + ROAD_HALF_WIDTH};
+        }
+        if (!across) {
+            across = &road;
+        }
+    }
+    if (across) {
+        // Поперёк дороги можно сместиться только в пределах её ширины
+        const double center = horizontal ? across->GetStart().x : across->GetStart().y;
+        return std::pair{center - ROAD_HALF_WIDTH, center + ROAD_HALF_WIDTH};
+    }
+    return std::nullopt;
+}
+
+DogStore::Index DogStore::Add(std::string name, Coordinate coordinate, Speed speed, Direction direction) {
+    const Index index = Size();
+    names_.emplace_back(std::move(name));
+    x_.push_back(coordinate.x);
+    y_.push_back(coordinate.y);
+    vx_.push_back(speed.vx);
+    vy_.push_back(speed.vy);
+    // Пока границы не заданы, пёс стоит на месте
+    min_x_.push_back(coordinate.x);
+    min_y_.push_back(coordinate.y);
+    max_x_.push_back(coordinate.x);
+    max_y_.push_back(coordinate.y);
+    directions_.push_back(direction);
+    return index;
+}
+
+namespace {
+
+// Сдвигает псов [begin, end) на time_delta секунд. Возвращает end
+size_t MoveDogsScalar(size_t begin, size_t end, double time_delta,
+                      double* x, double* y, double* vx, double* vy,
+                      const double* min_x, const double* min_y,
+                      const double* max_x, const double* max_y) noexcept {
+    for (size_t i = begin; i < end; ++i) {
+        const double new_x = x[i] + vx[i] * time_delta;
+        const double new_y = y[i] + vy[i] * time_delta;
+        const double clamped_x = std::min(std::max(new_x, min_x[i]), max_x[i]);
+        const double clamped_y = std::min(std::max(new_y, min_y[i]), max_y[i]);
+        if (clamped_x != new_x || clamped_y != new_y) {
+            // Упёрлись в конец коридора — останавливаемся на его границе
+            vx[i] = 0;
+            vy[i] = 0;
+        }
+        x[i] = clamped_x;
+        y[i] = clamped_y;
+    }
+    return end;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MODEL_HAS_AVX2_KERNEL
+
+// То же, что MoveDogsScalar, но по четыре пса за итерацию. Возвращает индекс
+// первого необработанного пса (хвост меньше четырёх псов остаётся скалярной версии)
+__attribute__((target("avx2")))
+size_t MoveDogsAvx2(size_t size, double time_delta,
+                    double* x, double* y, double* vx, double* vy,
+                    const double* min_x, const double* min_y,
+                    const double* max_x, const double* max_y) noexcept {
+    const __m256d dt = _mm256_set1_pd(time_delta);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        const __m256d cur_vx = _mm256_loadu_pd(vx + i);
+        const __m256d cur_vy = _mm256_loadu_pd(vy + i);
+        const __m256d new_x = _mm256_add_pd(_mm256_loadu_pd(x + i), _mm256_mul_pd(cur_vx, dt));
+        const __m256d new_y = _mm256_add_pd(_mm256_loadu_pd(y + i), _mm256_mul_pd(cur_vy, dt));
+        const __m256d clamped_x = _mm256_min_pd(_mm256_max_pd(new_x, _mm256_loadu_pd(min_x + i)), _mm256_loadu_pd(max_x + i));
+        const __m256d clamped_y = _mm256_min_pd(_mm256_max_pd(new_y, _mm256_loadu_pd(min_y + i)), _mm256_loadu_pd(max_y + i));
+        const __m256d stopped = _mm256_or_pd(_mm256_cmp_pd(clamped_x, new_x, _CMP_NEQ_UQ),
+                                             _mm256_cmp_pd(clamped_y, new_y, _CMP_NEQ_UQ));
+        _mm256_storeu_pd(vx + i, _mm256_andnot_pd(stopped, cur_vx));
+        _mm256_storeu_pd(vy + i, _mm256_andnot_pd(stopped, cur_vy));
+        _mm256_storeu_pd(x + i, clamped_x);
+        _mm256_storeu_pd(y + i, clamped_y);
+    }
+    return i;
+}
+#endif
+
+}  // namespace
+
+void DogStore::Move(double time_delta) noexcept {
+    size_t moved = 0;
+#ifdef MODEL_HAS_AVX2_KERNEL
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+        moved = MoveDogsAvx2(Size(), time_delta, x_.data(), y_.data(), vx_.data(), vy_.data(),
+                             min_x_.data(), min_y_.data(), max_x_.data(), max_y_.data());
+    }
+#endif
+    MoveDogsScalar(moved, Size(), time_delta, x_.data(), y_.data(), vx_.data(), vy_.data(),
+                   min_x_.data(), min_y_.data(), max_x_.data(), max_y_.data());
+}
+
+void DogStore::MoveScalar(double time_delta) noexcept {
+    MoveDogsScalar(0, Size(), time_delta, x_.data(), y_.data(), vx_.data(), vy_.data(),
+                   min_x_.data(), min_y_.data(), max_x_.data(), max_y_.data());
+}
+
+void Dog::UpdateBounds() noexcept {
+    const Coordinate coordinate = GetCoordinate();
+    const Speed speed = GetSpeed();
+    Coordinate min = coordinate;
+    Coordinate max = coordinate;
+    // Пёс движется только вдоль одной оси; вдоль другой он остаётся на месте
+    if (speed.vx != 0 || speed.vy != 0) {
+        const bool horizontal = speed.vx != 0;
+        if (auto range = map_->GetMoveRange(coordinate, horizontal)) {
+            (horizontal ? min.x : min.y) = range->first;
+            (horizontal ? max.x : max.y) = range->second;
+        }
+    }
+    store_->SetBounds(Index(), min, max);
+}
+
 void Game::AddMap(Map map) {
     const size_t index = maps_.size();
     if (auto [it, inserted] = map_id_to_index_.emplace(map.GetId(), index); !inserted) {
@@ -39,8 +286,6 @@ GameSession::DogPointer GameSession::AddDog(std::string name, const Road& road,
     model::Dog::Id dog_id{ static_cast<int>(index)};
     Coordinate random_coordinate ={0,0};
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
     /*
     if (road.IsHorizontal()) {
         // Если дорога горизонтальная, выбираем случайную координату по оси X между start и end
@@ -56,13 +301,16 @@ GameSession::DogPointer GameSession::AddDog(std::string name, const Road& road,
 
     // Направление пса по умолчанию — север
     Direction initial_direction = Direction::NORTH;
-    auto dog = std::make_shared<Dog>(dog_id, name,random_coordinate, dog_speed_initial, initial_direction);
     // std::cout<<"initial coord"<<road.GetStart().x <<" "<<road.GetStart().y<<std::endl<<road.GetEnd().x<<" "<<road.GetEnd().y<<std::endl;
     // std::cout<<"Random coord"<<random_coordinate.x<<" "<<random_coordinate.y<<std::endl;
-    if (auto [it, inserted] = dog_id_to_index_.emplace(dog.get()->GetId(), index); !inserted) {
-        throw std::invalid_argument("Dog with id "s + std::to_string(*dog.get()->GetId()) + " already exists"s);
+    if (auto [it, inserted] = dog_id_to_index_.emplace(dog_id, index); !inserted) {
+        throw std::invalid_argument("Dog with id "s + std::to_string(*dog_id) + " already exists"s);
      } else {
         try {
+            dog_store_.Add(std::move(name), random_coordinate, dog_speed_initial, initial_direction);
+            auto dog = std::make_shared<Dog>(dog_id, dog_store_, current_map_);
+            // Границы движения зависят от скорости и положения пса на карте
+            dog->SetSpeed(dog_speed_initial);
             dogs_.emplace_back(dog);
             return dog;   
         } catch (...) {
@@ -71,7 +319,154 @@ GameSession::DogPointer GameSession::AddDog(std::string name, const Road& road,
         }
     };
 }
+void GameSession::PublishSnapshot() {
+    const SnapshotPointer previous = GetSnapshot();
+    auto snapshot = std::make_shared<SessionSnapshot>();
+    snapshot->version = previous->version + 1;
+    const size_t size = dog_store_.Size();
+    if (previous->names->size() == size) {
+        snapshot->names = previous->names;
+    } else {
+        auto names = std::make_shared<std::vector<std::string>>(*previous->names);
+        for (DogStore::Index i = names->size(); i < size; ++i) {
+            names->push_back(dog_store_.GetName(i));
+        }
+        snapshot->names = std::move(names);
+    }
+    snapshot->dogs.reserve(size);
+    snapshot->changed_at.reserve(size);
+    for (DogStore::Index i = 0; i < size; ++i) {
+        const SessionSnapshot::DogState dog{dog_store_.GetCoordinate(i), dog_store_.GetSpeed(i), dog_store_.GetDirection(i)};
+        bool changed = true;
+        if (i < previous->dogs.size()) {
+            const auto& old = previous->dogs[i];
+            changed = old.coordinate.x != dog.coordinate.x || old.coordinate.y != dog.coordinate.y
+                || old.speed.vx != dog.speed.vx || old.speed.vy != dog.speed.vy
+                || old.direction != dog.direction;
+        }
+        snapshot->changed_at.push_back(changed ? snapshot->version : previous->changed_at[i]);
+        snapshot->dogs.push_back(dog);
+    }
+    Publish(std::move(snapshot));
+}
+
+bool GameSession::MarkDogMotion(const Dog::Id& dog_id) {
+    pending_motion_.push_back(dog_id);
+    return pending_motion_.size() == 1;
+}
+
+void GameSession::PublishDogMotion() {
+    if (pending_motion_.empty()) {
+        return;
+    }
+    const SnapshotPointer previous = GetSnapshot();
+    if (previous->dogs.size() != dog_store_.Size()) {
+        // Псы, вошедшие после последней публикации, в снимок ещё не попали
+        PublishSnapshot();
+        return;
+    }
+    const auto moved = [this, &previous](DogStore::Index i) {
+        const auto& dog = previous->dogs[i];
+        const Speed speed = dog_store_.GetSpeed(i);
+        return dog.speed.vx != speed.vx || dog.speed.vy != speed.vy || dog.direction != dog_store_.GetDirection(i);
+    };
+    // Если псы лишь повторили прежнюю команду, снимок и его готовые тела ответов остаются прежними
+    if (std::none_of(pending_motion_.begin(), pending_motion_.end(), [&moved](const Dog::Id& dog_id) {
+            return moved(static_cast<DogStore::Index>(*dog_id));
+        })) {
+        pending_motion_.clear();
+        return;
+    }
+    auto snapshot = std::make_shared<SessionSnapshot>();
+    snapshot->version = previous->version + 1;
+    snapshot->names = previous->names;
+    snapshot->dogs = previous->dogs;
+    snapshot->changed_at = previous->changed_at;
+    for (const Dog::Id& dog_id : pending_motion_) {
+        const auto i = static_cast<DogStore::Index>(*dog_id);
+        if (moved(i)) {
+            snapshot->dogs[i].speed = dog_store_.GetSpeed(i);
+            snapshot->dogs[i].direction = dog_store_.GetDirection(i);
+            snapshot->changed_at[i] = snapshot->version;
+        }
+    }
+    Publish(std::move(snapshot));
+}
+
+void GameSession::Publish(std::shared_ptr<SessionSnapshot> snapshot) {
+    if (tick_versions_.empty() || published_tick_ != ticks_) {
+        tick_versions_.push_back(snapshot->version);
+        if (tick_versions_.size() > SessionSnapshot::MAX_DELTA_TICKS + 1) {
+            tick_versions_.pop_front();
+        }
+        published_tick_ = ticks_;
+    }
+    snapshot->oldest_delta_version = tick_versions_.size() > SessionSnapshot::MAX_DELTA_TICKS ? tick_versions_.front() : 0;
+    // Снимок включает все отмеченные изменения скорости: полный — по построению,
+    // снимок действий — потому что публикует именно их
+    pending_motion_.clear();
+    std::atomic_store_explicit(&snapshot_, SnapshotPointer{std::move(snapshot)}, std::memory_order_release);
+}
+
+const std::vector<SessionSnapshot::DogCell>& SessionSnapshot::GetDogGrid() const {
+    std::call_once(dog_grid_once_, [this] {
+        dog_grid_.reserve(dogs.size());
+        for (size_t i = 0; i < dogs.size(); ++i) {
+            const auto& c = dogs[i].coordinate;
+            dog_grid_.push_back({DogGridKey(DogGridCell(c.x), DogGridCell(c.y)), static_cast<std::uint32_t>(i)});
+        }
+        std::sort(dog_grid_.begin(), dog_grid_.end(), [](const DogCell& lhs, const DogCell& rhs) {
+            return std::tie(lhs.key, lhs.dog) < std::tie(rhs.key, rhs.dog);
+        });
+    });
+    return dog_grid_;
+}
+
+std::vector<size_t> SessionSnapshot::FindDogsNear(const Coordinate& center, double radius) const {
+    std::vector<size_t> result;
+    const double radius_sq = radius * radius;
+    auto is_near = [&](size_t i) {
+        const double dx = dogs[i].coordinate.x - center.x;
+        const double dy = dogs[i].coordinate.y - center.y;
+        return dx * dx + dy * dy <= radius_sq;
+    };
+
+    // Границы считаются в double, чтобы огромный радиус не переполнил номер ячейки
+    auto cell_of = [](double c) {
+        return std::floor(c / DOG_GRID_CELL_SIZE);
+    };
+    const double min_x = cell_of(center.x - radius), max_x = cell_of(center.x + radius);
+    const double min_y = cell_of(center.y - radius), max_y = cell_of(center.y + radius);
+    // Если ячеек в круге больше, чем псов, быстрее проверить всех псов подряд
+    if ((max_x - min_x + 1) * (max_y - min_y + 1) >= static_cast<double>(dogs.size())) {
+        for (size_t i = 0; i < dogs.size(); ++i) {
+            if (is_near(i)) {
+                result.push_back(i);
+            }
+        }
+        return result;
+    }
+
+    const auto& grid = GetDogGrid();
+    for (auto cell_x = static_cast<std::int32_t>(min_x); cell_x <= static_cast<std::int32_t>(max_x); ++cell_x) {
+        for (auto cell_y = static_cast<std::int32_t>(min_y); cell_y <= static_cast<std::int32_t>(max_y); ++cell_y) {
+            const std::uint64_t key = DogGridKey(cell_x, cell_y);
+            auto it = std::lower_bound(grid.begin(), grid.end(), key, [](const DogCell& cell, std::uint64_t key) {
+                return cell.key < key;
+            });
+            for (; it != grid.end() && it->key == key; ++it) {
+                if (is_near(it->dog)) {
+                    result.push_back(it->dog);
+                }
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
 std::shared_ptr<GameSession> Game::AddGameSession(const Map& map_) {
+    std::unique_lock lock{*sessions_mutex_};
     size_t index = sessions_.size();
     model::GameSession::Id session_id{std::to_string(index)};
     auto session = std::make_shared<GameSession>(session_id, map_);
@@ -80,38 +475,84 @@ std::shared_ptr<GameSession> Game::AddGameSession(const Map& map_) {
 }
 
 Players::PlayerPointer Players::AddPlayer(std::string dog_name, std::shared_ptr<GameSession> session, bool random_points) {
-    PlayerTokens pltk_;
-    Token token = pltk_.generateToken();
+    const TokenKey key = PlayerTokens::GenerateKey();
+    Token token = PlayerTokens::ToToken(key);
 
+    PlayerPointer player_;
     if (random_points) {
-        std::random_device rd;
-        std::mt19937 gen(rd());
         auto roads_count = session.get()->GetMap().GetRoads().size();
         std::uniform_int_distribution<> dis(0, static_cast<int>(roads_count - 1));
-        const  Road& road = session.get()->GetMap().GetRoads()[dis(gen)];
+        const  Road& road = session.get()->GetMap().GetRoads()[dis(util::ThreadRandom::Get())];
         auto dog = session.get()->AddDog(dog_name, road, model::Speed(0,0));
-        auto player_ =std::make_shared<Player>(session, dog, token);
-        players_.emplace_back(std::move(player_));
+        player_ =std::make_shared<Player>(session, dog, token);
     } else {
         const  Road& road = session.get()->GetMap().GetRoads()[0];
         auto dog = session.get()->AddDog(dog_name, road, model::Speed(0,0));
-        auto player_ =std::make_shared<Player>(session, dog, token);
-        players_.emplace_back(std::move(player_));
+        player_ =std::make_shared<Player>(session, dog, token);
     }
-    return players_.back();
+    Shard& shard = GetShard(key);
+    std::unique_lock lock{shard.mutex};
+    shard.players.emplace(key, player_);
+    return player_;
 } 
 
-Players::PlayerPointer* Players::findPlayerByToken(Token& token) {
-    for (PlayerPointer& player : players_) {
-         if (player.get()->GetToken() == token) {
-            std::cout<< "good1"<<std::endl;
-            std::cout<< (player.get()->GetDog().get()->GetName())<<std::endl;
-            std::cout<< "good2"<<std::endl;
-            //std::cout<< *(player.get()->GetSession)<<std::endl;
-            std::cout<< "good3"<<std::endl;
-             return &player;
-         }
-    }   
+Players::PlayerPointer Players::findPlayerByToken(const Token& token) const {
+    if (auto key = ParseTokenKey(*token)) {
+        return findPlayerByToken(*key);
+    }
+    return nullptr;
+}
+
+Players::PlayerPointer Players::findPlayerByToken(const TokenKey& key) const {
+    const Shard& shard = GetShard(key);
+    std::shared_lock lock{shard.mutex};
+    if (auto it = shard.players.find(key); it != shard.players.end()) {
+        return it->second;
+    }
     return nullptr;
 }
+
+namespace {
+
+// Таблица значений шестнадцатеричных цифр; -1 для остальных символов
+constexpr std::array<int8_t, 256> HEX_DIGITS = [] {
+    std::array<int8_t, 256> table{};
+    for (auto& value : table) {
+        value = -1;
+    }
+    for (int c = '0'; c <= '9'; ++c) {
+        table[c] = static_cast<int8_t>(c - '0');
+    }
+    for (int c = 'a'; c <= 'f'; ++c) {
+        table[c] = static_cast<int8_t>(c - 'a' + 10);
+    }
+    return table;
+}();
+
+// Разбирает 16 цифр в 64-битное число. Признак ошибки копится в bad без ветвлений
+uint64_t ParseHex64(const char* hex, int& bad) noexcept {
+    uint64_t value = 0;
+    for (int i = 0; i < 16; ++i) {
+        const int digit = HEX_DIGITS[static_cast<unsigned char>(hex[i])];
+        bad |= digit;
+        value = (value << 4) | static_cast<uint64_t>(digit & 0xF);
+    }
+    return value;
+}
+
+}  // namespace
+
+std::optional<TokenKey> ParseTokenKey(std::string_view hex) noexcept {
+    if (hex.size() != 32) {
+        return std::nullopt;
+    }
+    int bad = 0;
+    TokenKey key;
+    key.hi = ParseHex64(hex.data(), bad);
+    key.lo = ParseHex64(hex.data() + 16, bad);
+    if (bad < 0) {
+        return std::nullopt;
+    }
+    return key;
+}
 }  // namespace model
@@ -2,12 +2,23 @@
 
 #include <boost/json.hpp>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <random>
 #include <iostream>  // for debugging
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <utility>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include "tagged.h"
+#include "thread_random.h"
 
 namespace detail {
 struct TokenTag {};
@@ -22,6 +33,9 @@ using Coord = Dimension;
 struct Point {
     Coord x, y;
 };
+// Половина ширины дороги: пёс считается находящимся на дороге,
+// если отклоняется от её оси не более чем на эту величину
+constexpr double ROAD_HALF_WIDTH = 0.4;
 // Структура для координат псов
 struct Coordinate {
     double x; // Координата по оси X
@@ -47,6 +61,19 @@ enum class Direction {
     EAST,  // Восток
     WEST   // Запад
 };
+// Обозначение направления в API: "U", "D", "L" или "R"
+constexpr std::string_view DirectionToString(Direction direction) noexcept {
+    if (direction == Direction::EAST) {
+        return "R";
+    } else if (direction == Direction::WEST) {
+        return "L";
+    } else if (direction == Direction::NORTH) {
+        return "U";
+    } else if (direction == Direction::SOUTH) {
+        return "D";
+    }
+    return "";
+}
 struct Size {
     Dimension width, height;
 };
@@ -182,8 +209,23 @@ public:
 
     void AddRoad(const Road& road) {
         roads_.emplace_back(road);
+        IndexRoad(roads_.size() - 1);
     }
 
+    // Находит дорогу, на которой находится точка coordinate (с учётом ширины дороги).
+    // Если подходят несколько дорог, возвращается добавленная раньше остальных.
+    // Сложность не зависит от числа дорог на карте.
+    const Road* FindRoad(const Coordinate& coordinate) const noexcept;
+
+    // Объединяет соприкасающиеся дороги, лежащие на одной прямой, в коридоры.
+    // Вызывается один раз после добавления всех дорог карты
+    void BuildRoadGraph();
+
+    // Отрезок [first, second], в пределах которого пёс из точки coordinate может
+    // двигаться по горизонтали (horizontal == true) или по вертикали, не покидая дорог.
+    // Пустой результат означает, что точка не лежит ни на одной дороге
+    std::optional<std::pair<double, double>> GetMoveRange(const Coordinate& coordinate, bool horizontal) const noexcept;
+
     void AddBuilding(const Building& building) {
         buildings_.emplace_back(building);
     }
@@ -196,10 +238,29 @@ public:
     
 private:
     using OfficeIdToIndex = std::unordered_map<Office::Id, size_t, util::TaggedHasher<Office::Id>>;
+    // Равномерная сетка над картой: ячейка -> индексы дорог, проходящих через неё
+    // (в порядке добавления дорог)
+    using RoadGrid = std::unordered_map<std::uint64_t, std::vector<size_t>>;
+    // Размер ячейки сетки в единицах карты
+    static constexpr Coord ROAD_GRID_CELL_SIZE = 16;
+
+    // Коридор — непрерывный участок из дорог одной ориентации на одной прямой
+    struct Corridor {
+        Coord begin;  // меньшая координата вдоль оси коридора
+        Coord end;    // большая координата вдоль оси коридора
+    };
+    using Corridors = std::vector<Corridor>;
+
+    static std::uint64_t RoadGridKey(Coord x, Coord y) noexcept;
+    static bool ContainsPoint(const Road& road, const Coordinate& coordinate) noexcept;
+    void IndexRoad(size_t index);
 
     Id id_;
     std::string name_;
     Roads roads_;
+    RoadGrid road_grid_;
+    Corridors corridors_;
+    std::vector<size_t> road_to_corridor_;
     Buildings buildings_;
 
     OfficeIdToIndex warehouse_id_to_index_;
@@ -208,109 +269,247 @@ private:
     Speed default_map_dog_speed;
 };
 
-class PlayerTokens {
-private:
-    std::random_device random_device_;
-    std::mt19937_64 generator1_{[this] {
-        std::uniform_int_distribution<std::mt19937_64::result_type> dist;
-        return dist(random_device_);
-    }()};
-    std::mt19937_64 generator2_{[this] {
-        std::uniform_int_distribution<std::mt19937_64::result_type> dist;
-        return dist(random_device_);
-    }()};
+// Токен игрока в двоичном виде: 32 шестнадцатеричные цифры — это ровно 128 бит.
+// Такой ключ сравнивается и хэшируется за пару инструкций, в отличие от строки
+struct TokenKey {
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    bool operator==(const TokenKey&) const = default;
+};
 
+struct TokenKeyHasher {
+    size_t operator()(const TokenKey& key) const noexcept {
+        // Токены случайны, так что достаточно дёшево перемешать обе половины
+        return static_cast<size_t>(key.lo ^ (key.hi * 0x9E3779B97F4A7C15ull));
+    }
+};
+
+// Разбирает 32 шестнадцатеричные цифры в нижнем регистре (в таком виде токены выдаются игрокам).
+// Возвращает std::nullopt, если строка не может быть токеном
+std::optional<TokenKey> ParseTokenKey(std::string_view hex) noexcept;
+
+// Выдаёт токены новым игрокам. Токен — секрет игрока, поэтому числа берутся
+// из криптостойкого SecureRandom, а не из предсказуемого ThreadRandom.
+// В строку они переводятся по таблице, без std::stringstream
+class PlayerTokens {
+public:
+    static TokenKey GenerateKey() {
+        auto& random = util::SecureRandom::Get();
+        TokenKey key;
+        key.hi = random.Next();
+        key.lo = random.Next();
+        return key;
+    }
+
+    static Token ToToken(const TokenKey& key) {
+        static constexpr char HEX_CHARS[] = "0123456789abcdef";
+        std::string token(32, '0');
+        for (int i = 0; i < 16; ++i) {
+            token[15 - i] = HEX_CHARS[(key.hi >> (i * 4)) & 0xF];
+            token[31 - i] = HEX_CHARS[(key.lo >> (i * 4)) & 0xF];
+        }
+        return Token(std::move(token));
+    }
+};
+// Хранилище псов игровой сессии в виде структуры массивов.
+// Координаты, скорости и границы движения всех псов лежат в непрерывных массивах,
+// поэтому за тик их можно обойти одним проходом без разыменования указателей
+class DogStore {
 public:
-    Token generateToken() {
-        auto num1 = generator1_();
-        auto num2 = generator2_();
-        
-        std::stringstream token_stream;
-        token_stream << std::hex << std::setfill('0')
-                     << std::setw(16) << num1
-                     << std::setw(16) << num2;
-        
-        return Token(token_stream.str());
+    using Index = size_t;
+
+    Index Add(std::string name, Coordinate coordinate, Speed speed, Direction direction);
+
+    size_t Size() const noexcept {
+        return x_.size();
+    }
+
+    const std::string& GetName(Index index) const noexcept {
+        return names_[index];
+    }
+    Coordinate GetCoordinate(Index index) const noexcept {
+        return {x_[index], y_[index]};
+    }
+    Speed GetSpeed(Index index) const noexcept {
+        return {vx_[index], vy_[index]};
+    }
+    Direction GetDirection(Index index) const noexcept {
+        return directions_[index];
+    }
+
+    void SetCoordinate(Index index, const Coordinate& coordinate) noexcept {
+        x_[index] = coordinate.x;
+        y_[index] = coordinate.y;
     }
+    void SetSpeed(Index index, const Speed& speed) noexcept {
+        vx_[index] = speed.vx;
+        vy_[index] = speed.vy;
+    }
+    void SetDirection(Index index, Direction direction) noexcept {
+        directions_[index] = direction;
+    }
+
+    // Устанавливает прямоугольник, в пределах которого пёс может двигаться с текущей скоростью.
+    // Вычисляется по карте при смене скорости и не меняется, пока пёс движется
+    void SetBounds(Index index, const Coordinate& min, const Coordinate& max) noexcept {
+        min_x_[index] = min.x;
+        min_y_[index] = min.y;
+        max_x_[index] = max.x;
+        max_y_[index] = max.y;
+    }
+
+    // Сдвигает всех псов на time_delta секунд. Пёс, упёршийся в границу, останавливается.
+    // На процессорах с AVX2 обрабатывает по четыре пса за итерацию
+    void Move(double time_delta) noexcept;
+
+    // Переносимая версия Move без векторных инструкций
+    void MoveScalar(double time_delta) noexcept;
+
+private:
+    std::vector<std::string> names_;
+    std::vector<double> x_;
+    std::vector<double> y_;
+    std::vector<double> vx_;
+    std::vector<double> vy_;
+    std::vector<double> min_x_;
+    std::vector<double> min_y_;
+    std::vector<double> max_x_;
+    std::vector<double> max_y_;
+    std::vector<Direction> directions_;
 };
+
+// Пёс — стабильный дескриптор записи в DogStore игровой сессии.
+// Индекс записи совпадает с Id пса и не меняется при добавлении новых псов
 class Dog{
 public:
     using Id = util::Tagged<int, Dog>;
-    explicit Dog(Id id, std::string name, Coordinate coordinate, Speed speed, Direction direction) noexcept
+    Dog(Id id, DogStore& store, const Map& map) noexcept
         : id_(std::move(id)),
-          name_(std::move(name)),
-          coordinate_(std::move(coordinate)),
-          speed_(std::move(speed)),
-          direction_(direction) {}
+          store_(&store),
+          map_(&map) {}
     const Id& GetId() const noexcept {
         return id_;
-    }const std::string& GetName() const noexcept {
-        return name_;
+    }
+    const std::string& GetName() const noexcept {
+        return store_->GetName(Index());
     }
     void SetCoordinateX(double coord) noexcept {
-        coordinate_.x = coord;
+        store_->SetCoordinate(Index(), {coord, GetCoordinate().y});
+        UpdateBounds();
     }
     void SetCoordinateY(double coord) noexcept {
-        coordinate_.y = coord;
+        store_->SetCoordinate(Index(), {GetCoordinate().x, coord});
+        UpdateBounds();
     }
     void SetSpeed(const Speed& speed) noexcept {
-        speed_ = speed;
+        store_->SetSpeed(Index(), speed);
+        UpdateBounds();
     }
     void SetDirection(Direction direction) noexcept {
-        direction_ = direction;
+        store_->SetDirection(Index(), direction);
     }
-    const Coordinate& GetCoordinate() const noexcept {
-        return coordinate_;
+    Coordinate GetCoordinate() const noexcept {
+        return store_->GetCoordinate(Index());
     }
 
-    const Speed& GetSpeed() const noexcept {
-        return speed_;
+    Speed GetSpeed() const noexcept {
+        return store_->GetSpeed(Index());
     }
 
     std::string GetDirection() const noexcept {
-        if (direction_ == Direction::EAST) {
-            return "R";
-        } else if (direction_ == Direction::WEST) {
-            return "L";
-        } else if (direction_ == Direction::NORTH) {
-            return "U";
-        } else if (direction_ == Direction::SOUTH) {
-            return "D";
-        }
-        return "";
+        return std::string(DirectionToString(GetDirectionENUM()));
     }
-    const Direction& GetDirectionENUM() const noexcept {
-        return direction_;
+    Direction GetDirectionENUM() const noexcept {
+        return store_->GetDirection(Index());
     }
 
-    const Road* GetCurrentRoad(const std::vector<Road>& roads, const Coordinate& coordinate) const {
-        for (const auto& road : roads) {
-            if (road.IsHorizontal()){
-                double max_coord_cur_x =std::max(road.GetStart().x,road.GetEnd().x); 
-                double min_coord_cur_x =std::min(road.GetStart().x,road.GetEnd().x); 
-                if ((coordinate.y <= road.GetStart().y + 0.4 && coordinate.y >= road.GetStart().y - 0.4) &&
-                    coordinate.x >= min_coord_cur_x - 0.4 && coordinate.x <= max_coord_cur_x + 0.4) {
-                    return &road;
-                }
-            }
-            if (road.IsVertical()){
-                double max_coord_cur_y =std::max(road.GetStart().y,road.GetEnd().y); 
-                double min_coord_cur_y =std::min(road.GetStart().y,road.GetEnd().y); 
-                if ((coordinate.x <= road.GetStart().x + 0.4 && coordinate.x >= road.GetStart().x - 0.4) &&
-                    coordinate.y >= min_coord_cur_y - 0.4 && coordinate.y <= max_coord_cur_y +0.4) {
-                    return &road;
-                }
-            }
-             // Собака не на дороге
-        }
-        return nullptr;
+    const Road* GetCurrentRoad(const Map& map, const Coordinate& coordinate) const noexcept {
+        return map.FindRoad(coordinate);
     }
 private:
+    DogStore::Index Index() const noexcept {
+        return static_cast<DogStore::Index>(*id_);
+    }
+    // Пересчитывает границы движения пса по коридорам карты
+    void UpdateBounds() noexcept;
+
     Id id_;
-    std::string name_;
-    Coordinate coordinate_; // Координаты пса на карте
-    Speed speed_;           // Скорость пса на карте
-    Direction direction_;   // Направление пса
+    DogStore* store_;
+    const Map* map_;
+};
+
+// Неизменяемый снимок состояния псов сессии. Публикуется в strand'е сессии
+// и читается из любых потоков без блокировок
+struct SessionSnapshot {
+    struct DogState {
+        Coordinate coordinate;
+        Speed speed;
+        Direction direction;
+    };
+    // Номер снимка; растёт с каждой публикацией — после тика, входа игрока и действий
+    std::uint64_t version = 0;
+    // Если клиент пропустил больше стольких тиков, вместо разницы отправляется полное состояние
+    static constexpr std::uint64_t MAX_DELTA_TICKS = 1000;
+    // Наименьшая версия, от которой ещё отправляется разница: первый снимок, опубликованный
+    // MAX_DELTA_TICKS тиков назад. Между тиками версия растёт и от действий игроков,
+    // поэтому отставание клиента считается в тиках, а не в версиях
+    std::uint64_t oldest_delta_version = 0;
+    // Имена псов меняются только при входе нового игрока, поэтому разделяются между снимками
+    std::shared_ptr<const std::vector<std::string>> names = std::make_shared<const std::vector<std::string>>();
+    // Индекс в векторе совпадает с Id пса
+    std::vector<DogState> dogs;
+    // Версия снимка, в которой состояние пса изменилось последний раз
+    std::vector<std::uint64_t> changed_at;
+
+    // Тело ответа, построенное по снимку. Строится при первом обращении
+    // и разделяется всеми читателями этого снимка
+    class CachedBody {
+    public:
+        using Pointer = std::shared_ptr<const std::string>;
+
+        template <typename Fn>
+        const Pointer& Get(Fn&& build) const {
+            std::call_once(once_, [this, &build] {
+                body_ = std::make_shared<const std::string>(build());
+            });
+            return body_;
+        }
+
+    private:
+        mutable std::once_flag once_;
+        mutable Pointer body_;
+    };
+    // Тело хранится отдельно для каждого формата ответа (JSON, CBOR)
+    static constexpr size_t BODY_FORMAT_COUNT = 2;
+    using CachedBodies = std::array<CachedBody, BODY_FORMAT_COUNT>;
+    CachedBodies state_body;
+    CachedBodies players_body;
+    // Разница с предыдущей версией — её запрашивают клиенты, не пропускающие снимков
+    CachedBodies delta_body;
+
+    // Номера псов не дальше radius от center, по возрастанию.
+    // Сетка псов строится при первом таком запросе к снимку, то есть не чаще раза за тик
+    std::vector<size_t> FindDogsNear(const Coordinate& center, double radius) const;
+
+private:
+    static constexpr double DOG_GRID_CELL_SIZE = 16.0;
+    struct DogCell {
+        std::uint64_t key;
+        std::uint32_t dog;
+    };
+
+    static std::int32_t DogGridCell(double c) noexcept {
+        return static_cast<std::int32_t>(std::floor(c / DOG_GRID_CELL_SIZE));
+    }
+    static std::uint64_t DogGridKey(std::int32_t cell_x, std::int32_t cell_y) noexcept {
+        return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cell_x)) << 32) | static_cast<std::uint32_t>(cell_y);
+    }
+    const std::vector<DogCell>& GetDogGrid() const;
+
+    mutable std::once_flag dog_grid_once_;
+    // Псы, упорядоченные по ячейке сетки: псы одной ячейки лежат подряд
+    mutable std::vector<DogCell> dog_grid_;
 };
 
 class GameSession {
@@ -320,6 +519,9 @@ public:
     using Id = util::Tagged<std::string, GameSession>;
     GameSession(Id id, Map map)
         : id_(std::move(id)), current_map_(map) {}
+    // Псы ссылаются на хранилище и карту сессии, поэтому сессию нельзя копировать
+    GameSession(const GameSession&) = delete;
+    GameSession& operator=(const GameSession&) = delete;
     const Id& GetId() const noexcept {
         return id_;
     }
@@ -329,8 +531,36 @@ public:
     Dogs& GetDogs() noexcept {
         return dogs_;
     }
+    const DogStore& GetDogStore() const noexcept {
+        return dog_store_;
+    }
     
     DogPointer AddDog(std::string name,const Road& road, const Speed& dog_speed_initial);
+
+    // Перемещает всех псов сессии на time_delta секунд
+    void Tick(double time_delta) noexcept {
+        dog_store_.Move(time_delta);
+        ++ticks_;
+    }
+
+    using SnapshotPointer = std::shared_ptr<const SessionSnapshot>;
+    // Публикует снимок текущего состояния псов. Вызывается в strand'е сессии
+    void PublishSnapshot();
+    // Отмечает, что скорость или направление пса изменились и должны попасть в снимок.
+    // Возвращает true, если до этого отмеченных псов не было: тогда вызывающий ставит
+    // PublishDogMotion в очередь strand'а, и все действия до неё публикуются одним снимком.
+    // Вызывается в strand'е сессии
+    bool MarkDogMotion(const Dog::Id& dog_id);
+    // Публикует снимок, в котором у отмеченных псов обновлены скорость и направление.
+    // Координаты меняются только тиком, а он публикует полный снимок, поэтому
+    // достаточно скопировать предыдущий снимок и поправить в нём этих псов.
+    // Если псов не отмечено (например, их уже опубликовал тик), ничего не делает.
+    // Вызывается в strand'е сессии
+    void PublishDogMotion();
+    // Возвращает последний опубликованный снимок. Можно вызывать из любого потока
+    SnapshotPointer GetSnapshot() const noexcept {
+        return std::atomic_load_explicit(&snapshot_, std::memory_order_acquire);
+    }
 private:
     Id id_;
     using DogIdHasher = util::TaggedHasher<Dog::Id>;
@@ -338,6 +568,18 @@ private:
     Dogs dogs_;
     DogIdToIndex dog_id_to_index_;
     Map current_map_;
+    DogStore dog_store_;
+    SnapshotPointer snapshot_ = std::make_shared<const SessionSnapshot>();
+    // Псы, изменившие скорость после последней публикации
+    std::vector<Dog::Id> pending_motion_;
+    // Число тиков сессии и тик, после которого опубликован последний снимок
+    std::uint64_t ticks_ = 0;
+    std::uint64_t published_tick_ = 0;
+    // Версии первых снимков после последних MAX_DELTA_TICKS + 1 тиков, от старых к новым
+    std::deque<std::uint64_t> tick_versions_;
+
+    // Выставляет снимку oldest_delta_version и делает его текущим
+    void Publish(std::shared_ptr<SessionSnapshot> snapshot);
 };
 
 
@@ -362,20 +604,34 @@ private:
     Token token_;
     
 };
+// Реестр игроков. Разбит на сегменты со своими блокировками, чтобы игроки,
+// входящие в игру на разных картах, и поиск по токену не мешали друг другу
 class Players{
 public:
     using PlayerPointer = std::shared_ptr<Player>;
     using Players_ = std::vector<PlayerPointer>;
     
+    // Добавляет пса в сессию, поэтому вызывается в strand этой сессии
     Players::PlayerPointer AddPlayer(std::string dog_name, std::shared_ptr<GameSession>, bool random_points);
-    Players::PlayerPointer* findPlayerByToken(Token& token);
+    // Можно вызывать из любого потока
+    Players::PlayerPointer findPlayerByToken(const Token& token) const;
+    Players::PlayerPointer findPlayerByToken(const TokenKey& key) const;
 
-    Players_& GetPlayers() noexcept {
-        return players_;
-    }
-    Players_ players_;
 private:
-    
+    static constexpr size_t SHARD_COUNT = 16;
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<TokenKey, PlayerPointer, TokenKeyHasher> players;
+    };
+
+    const Shard& GetShard(const TokenKey& key) const noexcept {
+        return shards_[key.hi % SHARD_COUNT];
+    }
+    Shard& GetShard(const TokenKey& key) noexcept {
+        return shards_[key.hi % SHARD_COUNT];
+    }
+
+    std::array<Shard, SHARD_COUNT> shards_;
 };
 
 
@@ -386,11 +642,15 @@ public:
 
     using Maps = std::vector<Map>;
     void AddMap(Map map);
+    // Сессии добавляются и ищутся из strand'ов разных карт, поэтому список сессий
+    // защищён блокировкой. Карты после загрузки не меняются и читаются без блокировок
     std::shared_ptr<GameSession> AddGameSession(const Map& map_);
     const Maps& GetMaps() const noexcept {
         return maps_;
     }
-    GameSessions& GetGameSessions() noexcept {
+    // Возвращает копию списка сессий, которую можно обходить без блокировок
+    GameSessions GetGameSessions() const {
+        std::shared_lock lock{*sessions_mutex_};
         return sessions_;
     }
 
@@ -401,10 +661,11 @@ public:
         return nullptr;
     }
 
-    GameSessionPointer* FindGameSessionByMap(const Map& map) noexcept {
+    GameSessionPointer FindGameSessionByMap(const Map& map) const {
+        std::shared_lock lock{*sessions_mutex_};
         for(auto& session: sessions_){
             if (session.get()->GetMap().GetId() == map.GetId()){
-                return &session;
+                return session;
             }
         }
         return nullptr;
@@ -417,6 +678,8 @@ private:
     MapIdToIndex map_id_to_index_;
     using GameSessionIdHasher = util::TaggedHasher<GameSession::Id>;
     using GameSessionIdToIndex = std::unordered_map<GameSession::Id, size_t, GameSessionIdHasher>;
+    // unique_ptr оставляет Game перемещаемым (json_loader::LoadGame возвращает игру по значению)
+    std::unique_ptr<std::shared_mutex> sessions_mutex_ = std::make_unique<std::shared_mutex>();
     GameSessions sessions_;
     GameSessionIdToIndex session_id_to_index_;
     int time_delta;
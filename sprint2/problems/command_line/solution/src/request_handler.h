@@ -1,12 +1,29 @@
 #pragma once
 #include "http_server.h"
 #include "model.h"
+#include "metrics.h"
+#include "game_serializer.h"
+#include "router.h"
+#include "static_content.h"
+#include "http_header.h"
 #include <filesystem>
 #include <cassert>
 #include <iostream>
 #include <locale>
 #include <string>
+#include <atomic>
+#include <charconv>
+#include <optional>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <algorithm>
+#include <cctype>
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <boost/beast.hpp>
+#include <boost/asio/post.hpp>
 //#include <boost/filesystem.hpp>
 
 
@@ -17,32 +34,117 @@ namespace json = boost::json;
 namespace fs = std::filesystem;
 namespace sys = boost::system;
 using namespace std;
+
+// Эндпоинты API. Путь запроса разбирается деревом маршрутов за один проход,
+// а обработчик выбирается по эндпоинту в switch
+enum class ApiEndpoint {
+    MAPS,
+    MAP_BY_ID,
+    JOIN_GAME,
+    PLAYERS,
+    STATE,
+    ACTION_BATCH,
+    ACTION,
+    METRICS,
+    TICK
+};
+
+// Допустимые методы маршрута — битовая маска по http::verb
+using MethodMask = std::uint64_t;
+
+constexpr MethodMask methodBit(http::verb method) noexcept {
+    return MethodMask{1} << static_cast<unsigned>(method);
+}
+
+inline constexpr MethodMask GET_METHODS = methodBit(http::verb::get);
+inline constexpr MethodMask GET_OR_HEAD_METHODS = methodBit(http::verb::get) | methodBit(http::verb::head);
+inline constexpr MethodMask POST_METHODS = methodBit(http::verb::post);
+
+struct ApiRoute {
+    ApiEndpoint endpoint = ApiEndpoint::MAPS;
+    MethodMask methods = 0;
+};
+
+// Новый эндпоинт добавляется строкой в таблицу и веткой в RequestHandler::handleApiRequest
+inline constexpr std::array API_ROUTES{
+    router::Route<ApiRoute>{"/api/v1/maps", {ApiEndpoint::MAPS, GET_METHODS}},
+    router::Route<ApiRoute>{"/api/v1/maps/{id}", {ApiEndpoint::MAP_BY_ID, GET_METHODS}},
+    router::Route<ApiRoute>{"/api/v1/game/join", {ApiEndpoint::JOIN_GAME, POST_METHODS}},
+    router::Route<ApiRoute>{"/api/v1/game/players", {ApiEndpoint::PLAYERS, GET_OR_HEAD_METHODS}},
+    router::Route<ApiRoute>{"/api/v1/game/state", {ApiEndpoint::STATE, GET_OR_HEAD_METHODS}},
+    router::Route<ApiRoute>{"/api/v1/game/player/actions", {ApiEndpoint::ACTION_BATCH, POST_METHODS}},
+    router::Route<ApiRoute>{"/api/v1/game/player/action", {ApiEndpoint::ACTION, POST_METHODS}},
+    router::Route<ApiRoute>{"/api/v1/metrics", {ApiEndpoint::METRICS, GET_OR_HEAD_METHODS}},
+    router::Route<ApiRoute>{"/api/v1/game/tick", {ApiEndpoint::TICK, POST_METHODS}},
+};
+
+inline constexpr router::Router<ApiRoute, router::CountNodes(API_ROUTES)> API_ROUTER{API_ROUTES};
+
+// Обёртка над send, которая помнит, отправлен ли ответ. После перемещения исходный объект
+// становится пустым, поэтому блок catch может проверить, что send ещё у него и ответ
+// не отправлен, и ответить ошибкой. Без ответа запросы конвейера, стоящие за этим,
+// ждали бы до таймаута соединения
+template <typename Send>
+class ResponseSender {
+public:
+    explicit ResponseSender(Send&& send)
+        : send_{std::move(send)} {
+    }
+
+    ResponseSender(ResponseSender&& other) noexcept(std::is_nothrow_move_constructible_v<Send>)
+        : send_{std::move(other.send_)} {
+        other.send_.reset();
+    }
+
+    ResponseSender& operator=(ResponseSender&& other) noexcept(std::is_nothrow_move_constructible_v<Send>) {
+        if (this != &other) {
+            send_ = std::move(other.send_);
+            other.send_.reset();
+        }
+        return *this;
+    }
+
+    ResponseSender(const ResponseSender&) = delete;
+    ResponseSender& operator=(const ResponseSender&) = delete;
+
+    template <typename Response>
+    void operator()(Response&& response) {
+        assert(send_);
+        Send send = std::move(*send_);
+        send_.reset();
+        send(std::forward<Response>(response));
+    }
+
+    explicit operator bool() const noexcept {
+        return send_.has_value();
+    }
+
+private:
+    std::optional<Send> send_;
+};
+
 class RequestHandler {
 public:
+    using Strand = boost::asio::strand<boost::asio::io_context::executor_type>;
     
-    explicit RequestHandler(model::Game& game, std::string path_static, bool random_spawn, boost::asio::strand<boost::asio::io_context::executor_type>& strand)
+    explicit RequestHandler(model::Game& game, std::string path_static, bool random_spawn, boost::asio::strand<boost::asio::io_context::executor_type>& strand,
+                            std::optional<int> state_coord_decimals = std::nullopt)
         : game_{game},
         path_{path_static},
         random_spawn_{random_spawn},
-        strand_{strand} { }
+        strand_{strand},
+        state_coord_decimals_{state_coord_decimals},
+        static_files_{path_static} {
+        // У каждой карты ровно одна игровая сессия, поэтому strand карты
+        // служит strand'ом её сессии. Набор карт после загрузки не меняется,
+        // так что таблица strand'ов читается без блокировок
+        for (const auto& map : game_.GetMaps()) {
+            session_strands_.emplace(map.GetId(), boost::asio::make_strand(strand_.get_inner_executor()));
+            subscribers_[map.GetId()];
+        }
+        prepareMapResponses();
+    }
     
-    std::unordered_map<std::string, std::string> mime_types = {
-    {".htm", "text/html"}, {".html", "text/html"}, 
-    {".css", "text/css"}, 
-    {".txt", "text/plain"},
-    {".js", "text/javascript"}, 
-    {".json", "application/json"}, 
-    {".xml", "application/xml"}, 
-    {".png", "image/png"},
-    {".jpg", "image/jpeg"}, {".jpe", "image/jpeg"}, {".jpeg", "image/jpeg"}, 
-    {".gif", "image/gif"},
-    {".bmp", "image/bmp"}, 
-    {".ico", "image/vnd.microsoft.icon"},
-    {".tiff", "image/tiff"}, {".tif", "image/tiff"},
-    {".svg", "image/svg+xml"}, {".svgz", "image/svg+xml"}, 
-    {".mp3", "audio/mpeg"}
-    };
-
     bool IsSubPath(fs::path path, fs::path base) {
         // Приводим оба пути к каноничному виду (без . и ..)    
         // Проверяем, что все компоненты base содержатся внутри path
@@ -55,20 +157,20 @@ public:
     }
 
     std::string get_mime_type(std::string extension) {
-        std::transform(extension.begin(), extension.end(), extension.begin(),
-                   [](unsigned char c) { return std::tolower(c); });
-        auto it = mime_types.find(extension);
-        if (it != mime_types.end()) {
-            return it->second;
-        }
-        return "application/octet-stream";
+        return std::string(static_content::GetMimeType(extension));
     }
 
     RequestHandler(const RequestHandler&) = delete;
     RequestHandler& operator=(const RequestHandler&) = delete;
 
+    // Статические файлы отдаются из памяти. С диска читаются только файлы, которых не было
+    // в корне при запуске или которые слишком велики для кеша
     template <typename Body, typename Allocator, typename Send>
     void handleRequest(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
+        if (const auto* file = findStaticFile(req.target())) {
+            sendStaticFile(std::move(req), std::move(send), *file);
+            return;
+        }
         auto target = req.target();
         std::string requested_path_in_str;
         if (target == "/") {
@@ -113,62 +215,131 @@ public:
         res.prepare_payload();
         send(std::move(res));
     }
+    // Карты и статические файлы не меняются, поэтому такие запросы обрабатываются сразу.
+    // Запросы к игре выполняются в strand'е сессии, к которой они относятся
     template <typename Body, typename Allocator, typename Send>
-    void handleRequestWithStrand(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, boost::asio::strand<boost::asio::io_context::executor_type>& strand) {
-        boost::asio::dispatch(strand, [this, req = std::move(req), send = std::move(send), strand]() mutable {
-            try {
-                // Обработаем запрос и сформируем соответствующий ответ
-                if (req.method() == http::verb::get && req.target() == "/api/v1/maps") {
-                    handleGetMaps(std::move(req), std::move(send));
-                } else if (req.method() == http::verb::get && req.target().starts_with("/api/v1/maps/")) {
-                    handleGetMapById(std::move(req), std::move(send));
-                } else if (req.target() == "/api/v1/game/join") {
-                    if (req.method() == http::verb::post){
-                        handleJoinGame(std::move(req), std::move(send));
-                    } else {
-                        send(badMethodNotPost(std::move(req)));
-                    }
-                } else if (req.target() == "/api/v1/game/players") {
-                    if (!(req.method() == http::verb::get || req.method() == http::verb::head)) {
-                        send(badMethodNotGetOrHead(std::move(req)));
-                    } else{
-                        handleGetPlayers(std::move(req), std::move(send));
-                    }
-                }else if (req.target() == "/api/v1/game/state") {
-                    if (!(req.method() == http::verb::get || req.method() == http::verb::head)) {
-                        send(badMethodNotGetOrHead(std::move(req)));
-                    } else{
-                        handleGetStateInformation(std::move(req), std::move(send));
-                    }
-                }else if (req.target() == "/api/v1/game/player/action") {
-                    if (req.method() == http::verb::post){
-                        handleAction(std::move(req), std::move(send));
-                    } else {
-                        send(badMethodNotPost(std::move(req)));
-                    }
-                } else if (req.target() == "/api/v1/game/tick") {
-                    if (req.method() == http::verb::post) {
-                    handleMovesTick(std::move(req), std::move(send));
-                    } else {
-                        send(badMethodNotPost(std::move(req)));
-                    }
-                }else if (req.target().starts_with("/api/")) {
-                    send(badRequest(std::move(req)));
-                } else {    
-                    handleRequest(std::move(req), std::move(send));
+    void handleRequestWithStrand(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send_response) {
+        ResponseSender<std::decay_t<Send>> send{std::move(send_response)};
+        try {
+            // Обработаем запрос и сформируем соответствующий ответ
+            if (const auto match = API_ROUTER.Find(getTargetPath(req.target()))) {
+                handleApiRequest(std::move(req), std::move(send), *match);
+            } else if (req.target().starts_with("/api/")) {
+                send(badRequest(std::move(req)));
+            } else {    
+                handleRequest(std::move(req), std::move(send));
+            }
+        } catch (std::exception& e) {
+            std::cerr << "Error handling request: " << e.what() << std::endl;
+            if (send) {
+                send(serverError(std::move(req)));
+            }
+        }
+    }
+
+    using ApiMatch = decltype(API_ROUTER)::Match;
+
+    template <typename Body, typename Allocator, typename Send>
+    void handleApiRequest(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, const ApiMatch& match) {
+        const ApiRoute& route = *match.value;
+        if ((route.methods & methodBit(req.method())) == 0) {
+            sendBadMethod(std::move(req), std::move(send), route.methods);
+            return;
+        }
+        switch (route.endpoint) {
+            case ApiEndpoint::MAPS:
+                handleGetMaps(std::move(req), std::move(send));
+                break;
+            case ApiEndpoint::MAP_BY_ID:
+                // Параметр указывает в req.target(), а запрос здесь передаётся по ссылке и не перемещается
+                handleGetMapById(std::move(req), std::move(send), match.params[0]);
+                break;
+            case ApiEndpoint::JOIN_GAME:
+                handleJoinGame(std::move(req), std::move(send));
+                break;
+            case ApiEndpoint::PLAYERS:
+                // Чтение идёт из опубликованного снимка, strand сессии не нужен
+                if (auto player_ = authorizePlayer(req, send)) {
+                    handleGetPlayers(std::move(req), std::move(send), *player_);
                 }
-            } catch (std::exception& e) {
-                std::cerr << "Error handling request: " << e.what() << std::endl;
-            }        
-        });
+                break;
+            case ApiEndpoint::STATE:
+                if (auto player_ = authorizePlayer(req, send)) {
+                    handleGetStateInformation(std::move(req), std::move(send), *player_);
+                }
+                break;
+            case ApiEndpoint::ACTION_BATCH:
+                handleActionBatch(std::move(req), std::move(send));
+                break;
+            case ApiEndpoint::ACTION:
+                handleWithPlayer(std::move(req), std::move(send), [this](auto&& req, auto&& send, model::Player& player) {
+                    handleAction(std::move(req), std::move(send), player);
+                });
+                break;
+            case ApiEndpoint::METRICS:
+                handleGetMetrics(std::move(req), std::move(send));
+                break;
+            case ApiEndpoint::TICK:
+                handleMovesTick(std::move(req), std::move(send));
+                break;
+        }
+    }
+
+    // Ответ на запрос к известному пути с неподходящим методом
+    template <typename Body, typename Allocator, typename Send>
+    void sendBadMethod(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, MethodMask allowed) {
+        if (allowed == POST_METHODS) {
+            send(badMethodNotPost(std::move(req)));
+        } else if (allowed == GET_OR_HEAD_METHODS) {
+            send(badMethodNotGetOrHead(std::move(req)));
+        } else {
+            // Карты отвечают только на GET, остальные методы для них — неверный запрос
+            send(badRequest(std::move(req)));
+        }
     }
+
     template <typename Body, typename Allocator, typename Send>
     void operator()(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
-        handleRequestWithStrand(std::move(req), std::move(send), strand_);
+        handleRequestWithStrand(std::move(req), std::move(send));
+    }
+
+    // Подписка на состояние игры по WebSocket: /api/v1/game/ws.
+    // Токен передаётся в заголовке Authorization или, для браузеров, в параметре token.
+    // После подключения клиент получает текущее состояние, а затем по кадру на каждый тик
+    void HandleWebSocket(http::request<http::string_body>&& req, std::shared_ptr<http_server::WebSocketSession> ws) {
+        if (getTargetPath(req.target()) != "/api/v1/game/ws") {
+            ws->Reject(badRequest(std::move(req)));
+            return;
+        }
+        std::string_view token_str;
+        if (auto it = req.find(http::field::authorization); it != req.end()) {
+            const std::string_view auth_header = it->value();
+            if (auth_header.starts_with("Bearer ")) {
+                token_str = auth_header.substr(std::strlen("Bearer "));
+            }
+        } else if (auto token_param = getQueryParam(getTargetQuery(req.target()), "token")) {
+            token_str = *token_param;
+        }
+        const auto token = model::ParseTokenKey(token_str);
+        auto player = token ? players_.findPlayerByToken(*token) : nullptr;
+        if (!player) {
+            ws->Reject(badToken(std::move(req)));
+            return;
+        }
+        auto session = player->GetSession();
+        ws->Accept(std::move(req), [this, ws_weak = std::weak_ptr{ws}, session] {
+            // Список подписчиков сессии меняется только в её strand'е
+            boost::asio::dispatch(getSessionStrand(*session), [this, ws_weak, session] {
+                if (auto ws = ws_weak.lock()) {
+                    subscribers_.at(session->GetMap().GetId()).push_back(ws_weak);
+                    ws->Send(getStateBody(*session->GetSnapshot()));
+                }
+            });
+        });
     }
     void Tick(std::chrono::milliseconds delta){
         int millisecondsAsInt = static_cast<int>(delta.count());
-        UpdateCoords(millisecondsAsInt*0.001, game_.GetGameSessions());
+        UpdateCoords(millisecondsAsInt*0.001, game_.GetGameSessions(), [] {});
     }
 private:
     std::string url_decode(const std::string& s) {
@@ -197,79 +368,220 @@ private:
     }
     
 
+    // Часть запроса до '?'
+    static std::string_view getTargetPath(std::string_view target) {
+        return target.substr(0, target.find('?'));
+    }
+    // Часть запроса после '?'
+    static std::string_view getTargetQuery(std::string_view target) {
+        const auto question = target.find('?');
+        return question == std::string_view::npos ? std::string_view{} : target.substr(question + 1);
+    }
+    // Значение параметра name из строки запроса вида a=1&b=2
+    static std::optional<std::string_view> getQueryParam(std::string_view query, std::string_view name) {
+        while (!query.empty()) {
+            const auto amp = query.find('&');
+            const auto param = query.substr(0, amp);
+            query = amp == std::string_view::npos ? std::string_view{} : query.substr(amp + 1);
+            const auto eq = param.find('=');
+            if (param.substr(0, eq) == name) {
+                return eq == std::string_view::npos ? std::string_view{} : param.substr(eq + 1);
+            }
+        }
+        return std::nullopt;
+    }
+
     template <typename Body, typename Allocator, typename Send>
     void handleGetMaps(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
-        json::array maps_list_;
-        for (const auto& map : game_.GetMaps()) {
-            std::cout << *(map.GetId()) << std::endl;
-            maps_list_.push_back(json::object{
-                { "id", *(map.GetId())},
-                {"name", map.GetName()}
-                });
-        }
-        sendResponseToAuth(std::move(req), std::move(send), maps_list_);
+        sendPreparedResponse(std::move(req), std::move(send), maps_response_);
     }
 
-    json::value toJson(const model::Road& road) {
-        json::object road_json {
-            {"x0", road.GetStart().x},
-            {"y0", road.GetStart().y}
-        };
+    // Ответ, сериализованный заранее, и его строгий ETag
+    struct PreparedResponse {
+        std::shared_ptr<const std::string> body;
+        std::string etag;
+    };
+    // Один и тот же ответ в каждом из форматов; индекс — game_serializer::Format
+    using PreparedResponses = std::array<PreparedResponse, model::SessionSnapshot::BODY_FORMAT_COUNT>;
 
-        if (road.IsHorizontal()) {
-            road_json["x1"] = road.GetEnd().x;
-        } else if (road.IsVertical()) {
-            road_json["y1"] = road.GetEnd().y;
-        }
+    static PreparedResponse makePreparedResponse(std::string serialized) {
+        // Одинаковое содержимое даёт одинаковый ETag и после перезапуска сервера.
+        // Тела разных форматов различаются, а с ними и ETag
+        std::string etag = static_content::MakeStrongEtag(serialized);
+        return {std::make_shared<const std::string>(std::move(serialized)), std::move(etag)};
+    }
 
-        return road_json;
+    template <typename Serialize>
+    static PreparedResponses makePreparedResponses(Serialize&& serialize) {
+        return {makePreparedResponse(serialize(game_serializer::Format::JSON)),
+                makePreparedResponse(serialize(game_serializer::Format::CBOR))};
     }
-    json::value toJson(const model::Building& building) {
-        const auto& bounds = building.GetBounds();
-        return json::object{
-            {"x", bounds.position.x},
-            {"y", bounds.position.y},
-            {"w", bounds.size.width},
-            {"h", bounds.size.height}
-        };
+
+    // Карты не меняются после загрузки игры, поэтому ответы со списком карт
+    // и с описанием каждой карты сериализуются один раз при запуске
+    void prepareMapResponses() {
+        for (const auto& map : game_.GetMaps()) {
+            map_responses_.emplace(*map.GetId(), makePreparedResponses([&map](game_serializer::Format format) {
+                return game_serializer::SerializeMap(map, format);
+            }));
+        }
+        maps_response_ = makePreparedResponses([this](game_serializer::Format format) {
+            return game_serializer::SerializeMapList(game_.GetMaps(), format);
+        });
     }
 
-    json::value toJson(const model::Office& office) {
-        const auto& position = office.GetPosition();
-        const auto & offset = office.GetOffset();
-        return json::object{
-            {"id", *office.GetId()},
-            {"x", position.x},
-            {"y", position.y},
-            {"offsetX", offset.dx},
-            {"offsetY", offset.dy}
-        };
+    // Вес q, с которым заголовок Accept принимает media_type. Берётся у самого точного
+    // подходящего диапазона: "application/cbor", затем "application/*", затем "*/*".
+    // Если ни один диапазон не подходит, тип не принимается (вес 0)
+    static double acceptWeight(std::string_view accept, std::string_view media_type) {
+        using http_header::EqualsIgnoreCase;
+        const std::string_view type = media_type.substr(0, media_type.find('/'));
+        double weight = 0;
+        int best_specificity = -1;
+        http_header::ForEachWeighted(accept, [&](std::string_view range, double q) {
+            int specificity = -1;
+            if (EqualsIgnoreCase(range, media_type)) {
+                specificity = 2;
+            } else if (range.size() == type.size() + 2 && EqualsIgnoreCase(range.substr(0, type.size()), type) && range.ends_with("/*")) {
+                specificity = 1;
+            } else if (range == "*/*") {
+                specificity = 0;
+            }
+            if (specificity > best_specificity) {
+                best_specificity = specificity;
+                weight = q;
+            }
+        });
+        return weight;
+    }
+
+    // Формат тела ответа по заголовку Accept: CBOR, если клиент предпочитает его JSON.
+    // При равных весах и без заголовка — JSON
+    template <typename Body, typename Allocator>
+    static game_serializer::Format getResponseFormat(const http::request<Body, http::basic_fields<Allocator>>& req) {
+        using game_serializer::Format;
+        const auto it = req.find(http::field::accept);
+        if (it == req.end()) {
+            return Format::JSON;
+        }
+        const std::string_view accept = it->value();
+        return acceptWeight(accept, game_serializer::ContentType(Format::CBOR)) > acceptWeight(accept, game_serializer::ContentType(Format::JSON))
+            ? Format::CBOR
+            : Format::JSON;
     }
 
-    json::value toJson(const std::vector<model::Road>& roads) {
-        json::array roads_json;
-        for (const model::Road road : roads) {
-            roads_json.push_back(toJson(road));
+    // Проверяет, есть ли etag в значении заголовка If-None-Match.
+    // Для If-None-Match используется слабое сравнение, поэтому префикс W/ игнорируется
+    static bool etagMatches(std::string_view if_none_match, std::string_view etag) {
+        while (!if_none_match.empty()) {
+            const auto comma = if_none_match.find(',');
+            std::string_view candidate = http_header::Trim(if_none_match.substr(0, comma));
+            if_none_match = comma == std::string_view::npos ? std::string_view{} : if_none_match.substr(comma + 1);
+            if (candidate.starts_with("W/")) {
+                candidate.remove_prefix(2);
+            }
+            if (candidate == "*" || candidate == etag) {
+                return true;
+            }
         }
-        return roads_json;
+        return false;
     }
 
-    json::value toJson(const std::vector<model::Building>& buildings) {
-        json::array buildings_json;
-        for (const model::Building& building : buildings) {
-            buildings_json.push_back(toJson(building));
+    // Отправляет заранее сериализованный ответ или 304, если у клиента уже есть эта версия
+    template <typename Body, typename Allocator, typename Send>
+    void sendPreparedResponse(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, const PreparedResponses& responses) {
+        const auto format = getResponseFormat(req);
+        const auto& prepared = responses[static_cast<size_t>(format)];
+        if (auto it = req.find(http::field::if_none_match); it != req.end() && etagMatches(it->value(), prepared.etag)) {
+            // Заголовки ответа размещаются в памяти соединения, как и заголовки запроса
+            http::response<http::empty_body, http::basic_fields<Allocator>> res{
+                std::piecewise_construct, std::make_tuple(), std::make_tuple(req.get_allocator())};
+            res.result(http::status::not_modified);
+            res.version(req.version());
+            res.set(http::field::etag, prepared.etag);
+            res.set(http::field::cache_control, "no-cache");
+            res.set(http::field::vary, "Accept");
+            send(std::move(res));
+            return;
         }
-        return buildings_json;
+        http::response<http_server::SharedStringBody, http::basic_fields<Allocator>> res{
+            std::piecewise_construct, std::make_tuple(prepared.body), std::make_tuple(req.get_allocator())};
+        res.result(http::status::ok);
+        res.version(req.version());
+        res.set(http::field::content_type, game_serializer::ContentType(format));
+        res.set(http::field::cache_control, "no-cache");
+        res.set(http::field::vary, "Accept");
+        res.set(http::field::etag, prepared.etag);
+        res.content_length(http_server::SharedStringBody::size(res.body()));
+        send(std::move(res));
     }
 
-    json::value toJson(const std::vector<model::Office>& offices) {
-        json::array offices_json;
-        for (const model::Office& office : offices) {
-            offices_json.push_back(toJson(office));
+    // Файл из кеша по пути запроса. Строка запроса (например, ?v=2 для сброса кеша браузера) не учитывается
+    const static_content::StaticFile* findStaticFile(std::string_view target) {
+        std::string_view path = getTargetPath(target);
+        if (path == "/") {
+            return static_files_.Find("/index.html");
+        }
+        if (path.find_first_of("%+") == std::string_view::npos) {
+            return static_files_.Find(path);
         }
+        return static_files_.Find(url_decode(std::string(path)));
+    }
 
-        return offices_json;
+    // Отправляет файл из кеша в кодировании, которое принимает клиент, или 304,
+    // если у клиента уже есть эта версия файла
+    template <typename Body, typename Allocator, typename Send>
+    void sendStaticFile(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, const static_content::StaticFile& file) {
+        std::string_view accept_encoding;
+        if (auto it = req.find(http::field::accept_encoding); it != req.end()) {
+            accept_encoding = it->value();
+        }
+        const auto encoding = static_content::ChooseEncoding(accept_encoding, file);
+        const auto& variant = file.GetVariant(encoding);
+        bool not_modified = false;
+        if (auto it = req.find(http::field::if_none_match); it != req.end()) {
+            not_modified = etagMatches(it->value(), variant.etag);
+        } else if (auto it = req.find(http::field::if_modified_since); it != req.end()) {
+            // Файл не изменился, если он изменён не позже указанной даты.
+            // Нечитаемая дата игнорируется, и клиент получает файл целиком
+            const auto since = static_content::ParseHttpDate(it->value());
+            not_modified = since && file.modified_at <= *since;
+        }
+        const auto set_validators = [&req, &file, &variant](auto& res) {
+            res.version(req.version());
+            res.set(http::field::etag, variant.etag);
+            res.set(http::field::last_modified, file.last_modified);
+            if (file.HasCompressedVariants()) {
+                res.set(http::field::vary, "Accept-Encoding");
+            }
+        };
+        const auto set_representation = [&file, &variant, encoding](auto& res) {
+            res.set(http::field::content_type, file.content_type);
+            if (encoding != static_content::Encoding::IDENTITY) {
+                res.set(http::field::content_encoding, static_content::ContentEncoding(encoding));
+            }
+            res.content_length(variant.body->size());
+        };
+        // Заголовки ответа размещаются в памяти соединения, как и заголовки запроса
+        if (not_modified || req.method() == http::verb::head) {
+            http::response<http::empty_body, http::basic_fields<Allocator>> res{
+                std::piecewise_construct, std::make_tuple(), std::make_tuple(req.get_allocator())};
+            res.result(not_modified ? http::status::not_modified : http::status::ok);
+            set_validators(res);
+            if (!not_modified) {
+                set_representation(res);
+            }
+            send(std::move(res));
+            return;
+        }
+        http::response<http_server::SharedStringBody, http::basic_fields<Allocator>> res{
+            std::piecewise_construct, std::make_tuple(variant.body), std::make_tuple(req.get_allocator())};
+        res.result(http::status::ok);
+        set_validators(res);
+        set_representation(res);
+        send(std::move(res));
     }
+
     template <typename Body, typename Allocator, typename Send>
     void handleJoinGame(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
         json::error_code ec;
@@ -307,32 +619,37 @@ private:
             return;
         }
         
-        if (auto session_yet = game_.FindGameSessionByMap(*map); session_yet) {
-            auto player_ = players_.AddPlayer(name,*session_yet,random_spawn_);
-            json::object player_json{
-                {"authToken",  *(players_.players_.back().get()->GetToken())},
-                {"playerId", *(players_.players_.back().get()->GetDog()->GetId())}
-            };
-            sendResponseToAuth(std::move(req), std::move(send), player_json);
-            
-        
-        } else {
-            std::cout<<"of no"<< std::endl;
-            auto new_session = game_.AddGameSession(*map);
-            //std::cout<<"new: " << *(new_session.GetId())<<std::endl;
-            auto player_ = players_.AddPlayer(name, new_session, random_spawn_);
-            json::object player_json{
-                {"authToken",  *(players_.players_.back().get()->GetToken())},
-                {"playerId", *(players_.players_.back().get()->GetDog()->GetId())}
-            };
-            sendResponseToAuth(std::move(req), std::move(send), player_json);
-        }
+        // Сессию карты создаём и пополняем только в strand'е этой карты,
+        // поэтому входы в игру на разных картах выполняются параллельно
+        boost::asio::dispatch(session_strands_.at(map->GetId()),
+            [this, map, name = std::move(name), req = std::move(req), send = std::move(send)]() mutable {
+            try {
+                auto session = game_.FindGameSessionByMap(*map);
+                if (!session) {
+                    session = game_.AddGameSession(*map);
+                }
+                auto player_ = players_.AddPlayer(name, session, random_spawn_);
+                session.get()->PublishSnapshot();
+                json::object player_json{
+                    {"authToken",  *(player_->GetToken())},
+                    {"playerId", *(player_->GetDog()->GetId())}
+                };
+                sendResponseToAuth(std::move(req), std::move(send), player_json);
+            } catch (std::exception& e) {
+                std::cerr << "Error handling request: " << e.what() << std::endl;
+                if (send) {
+                    send(serverError(std::move(req)));
+                }
+            }
+        });
     }
+    // Проверяет заголовок Authorization и находит игрока по токену.
+    // Если игрок не найден, отправляет ответ с ошибкой и возвращает nullptr
     template <typename Body, typename Allocator, typename Send>
-    void handleGetPlayers(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
+    model::Players::PlayerPointer authorizePlayer(http::request<Body, http::basic_fields<Allocator>>& req, Send& send) {
         if (req.find("Authorization")==req.end()) {
             send(missingAuthHeaderToAuth(std::move(req)));
-            return;
+            return nullptr;
         }
         auto auth_header = req["Authorization"];
         const std::string bearer_prefix = "Bearer ";
@@ -340,326 +657,335 @@ private:
             auth_header.substr(0, bearer_prefix.size()) != bearer_prefix) 
         {
             send(invalidAuthHeaderToAuth(std::move(req)));
-            return;
+            return nullptr;
         }
-        std::string token_str = std::string(auth_header.substr(bearer_prefix.size()));
+        const std::string_view token_str = auth_header.substr(bearer_prefix.size());
         if (token_str.empty() || token_str.size() != 32) {
             send(invalidAuthHeaderToAuth(std::move(req)));
+            return nullptr;
+        }
+        // Токен разбирается прямо из заголовка, без промежуточной строки
+        const auto token = model::ParseTokenKey(token_str);
+        auto player_ = token ? players_.findPlayerByToken(*token) : nullptr;
+        if (!player_) {
+            send(badToken(std::move(req)));
+        }
+        return player_;
+    }
+
+    // Авторизует игрока и вызывает handler(req, send, player) в strand'е его сессии
+    template <typename Body, typename Allocator, typename Send, typename Handler>
+    void handleWithPlayer(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, Handler&& handler) {
+        auto player_ = authorizePlayer(req, send);
+        if (!player_) {
             return;
         }
-            Token token{token_str};
-            auto player_ = players_.findPlayerByToken(token);
-            if (!player_) {
-                send(badToken(std::move(req)));
-            } else {
-            json::object players;
-            int index = 0;
-            for(auto& dog :player_->get()->GetSession().get()->GetDogs()){
-                players[std::to_string(index++)] =json::object{
-                    {"name", dog.get()->GetName()}
-                    };
+        auto& strand = getSessionStrand(*player_->GetSession());
+        boost::asio::dispatch(strand, [this, req = std::move(req), send = std::move(send), player_,
+                                       handler = std::forward<Handler>(handler)]() mutable {
+            try {
+                handler(std::move(req), std::move(send), *player_);
+            } catch (std::exception& e) {
+                std::cerr << "Error handling request: " << e.what() << std::endl;
+                if (send) {
+                    send(serverError(std::move(req)));
+                }
+            }
+        });
+    }
+
+    Strand& getSessionStrand(const model::GameSession& session) {
+        return session_strands_.at(session.GetMap().GetId());
+    }
+
+    // Полное состояние снимка; сериализуется один раз на формат и разделяется
+    // HTTP-ответами и WebSocket-кадрами (они всегда в JSON)
+    const std::shared_ptr<const std::string>& getStateBody(const model::SessionSnapshot& snapshot,
+                                                           game_serializer::Format format = game_serializer::Format::JSON) {
+        return snapshot.state_body[static_cast<size_t>(format)].Get([this, &snapshot, format] {
+            return game_serializer::SerializeState(snapshot, state_coord_decimals_, format);
+        });
+    }
+
+    // Рассылает подписчикам сессии только что опубликованный снимок.
+    // Вызывается в strand'е сессии
+    void pushState(const model::GameSession& session) {
+        auto& subscribers = subscribers_.at(session.GetMap().GetId());
+        if (subscribers.empty()) {
+            return;
+        }
+        const auto& body = getStateBody(*session.GetSnapshot());
+        std::erase_if(subscribers, [&body](const std::weak_ptr<http_server::WebSocketSession>& subscriber) {
+            auto ws = subscriber.lock();
+            if (!ws || !ws->IsOpen()) {
+                return true;
             }
-            sendResponseToAuth(std::move(req), std::move(send), players);
-            } 
+            ws->Send(body);
+            return false;
+        });
     }
+
     template <typename Body, typename Allocator, typename Send>
-    void handleGetStateInformation(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
-        if (req.find("Authorization")==req.end()) {
-            send(missingAuthHeaderToAuth(std::move(req)));
+    void handleGetPlayers(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, model::Player& player) {
+        metrics::ScopedTimer timer{state_read_latency_};
+        const auto snapshot = player.GetSession().get()->GetSnapshot();
+        const auto format = getResponseFormat(req);
+        // Список одинаков для всех игроков сессии, поэтому сериализуем его один раз на снимок
+        auto body = snapshot->players_body[static_cast<size_t>(format)].Get([&snapshot, format] {
+            return game_serializer::SerializePlayers(*snapshot, format);
+        });
+        sendSharedResponseToAuth(std::move(req), std::move(send), std::move(body), format);
+    }
+    template <typename Body, typename Allocator, typename Send>
+    void handleGetStateInformation(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, model::Player& player) {
+        metrics::ScopedTimer timer{state_read_latency_};
+        const auto snapshot = player.GetSession().get()->GetSnapshot();
+        const auto query = getTargetQuery(req.target());
+        const auto format = getResponseFormat(req);
+        if (query.empty()) {
+            // Состояние одинаково для всех игроков сессии до следующего тика,
+            // поэтому сериализуем его один раз на снимок и отдаём всем общий буфер
+            sendSharedResponseToAuth(std::move(req), std::move(send), getStateBody(*snapshot, format), format);
             return;
         }
-        auto auth_header = req["Authorization"];
-        const std::string bearer_prefix = "Bearer ";
-        if (auth_header.size() <= bearer_prefix.size() ||
-            auth_header.substr(0, bearer_prefix.size()) != bearer_prefix) 
-        {
-            send(invalidAuthHeaderToAuth(std::move(req)));
+        const auto since_str = getQueryParam(query, "since");
+        const auto radius_str = getQueryParam(query, "radius");
+        if (radius_str && !since_str) {
+            // ?radius=<r>: только псы не дальше r от пса игрока
+            double radius = 0;
+            if (radius_str->empty()
+                || std::from_chars(radius_str->data(), radius_str->data() + radius_str->size(), radius).ptr != radius_str->data() + radius_str->size()
+                || !std::isfinite(radius) || radius < 0) {
+                send(badStateQuery(std::move(req)));
+                return;
+            }
+            std::vector<size_t> dog_ids;
+            // Снимок мог быть опубликован до того, как пёс игрока появился в сессии
+            if (const size_t dog_id = *player.GetDog()->GetId(); dog_id < snapshot->dogs.size()) {
+                dog_ids = snapshot->FindDogsNear(snapshot->dogs[dog_id].coordinate, radius);
+            }
+            auto body = std::make_shared<const std::string>(game_serializer::SerializeStateOf(*snapshot, dog_ids, state_coord_decimals_, format));
+            sendSharedResponseToAuth(std::move(req), std::move(send), std::move(body), format);
             return;
         }
-        std::string token_str = std::string(auth_header.substr(bearer_prefix.size()));
-        if (token_str.empty() || token_str.size() != 32) {
-            send(invalidAuthHeaderToAuth(std::move(req)));
+        // ?since=<version>: только псы, изменившиеся после этой версии
+        std::uint64_t since = 0;
+        if (!since_str || radius_str || since_str->empty()
+            || std::from_chars(since_str->data(), since_str->data() + since_str->size(), since).ptr != since_str->data() + since_str->size()) {
+            send(badStateQuery(std::move(req)));
             return;
         }
-            Token token{token_str};
-            auto player_ = players_.findPlayerByToken(token);
-            
-            if (!player_) {
-                send(badToken(std::move(req)));
-            } else {
-            std::cout <<*(player_->get()->GetToken())<<std::endl;
-            std::cout<< (player_->get()->GetDog().get()->GetName())<<std::endl;
-            //std::cout <<*(player_->get()->GetSession().GetId())<<"   " <<*(player_->get()->GetSession().GetMap().GetId())<<std::endl;
-            json::object players;
-            for(auto dog :player_->get()->GetSession().get()->GetDogs()){  
-                std::cout <<*(player_->get()->GetToken())<<std::endl;
-                players[std::to_string(*(dog.get()->GetId()))] = json::object{
-                    {"pos", json::array{dog.get()->GetCoordinate().x, dog.get()->GetCoordinate().y}},
-                    {"speed",json::array{ dog.get()->GetSpeed().vx, dog.get()->GetSpeed().vy}},
-                    {"dir", dog.get()->GetDirection()}
-                    };
-            }
-            json::object response;
-            response["players"] = players; 
-            sendResponseToAuth(std::move(req), std::move(send), response); 
-            } 
+        std::shared_ptr<const std::string> body;
+        if (since + 1 == snapshot->version) {
+            // Клиенты, не пропускающие тиков, получают одну и ту же разницу
+            body = snapshot->delta_body[static_cast<size_t>(format)].Get([this, &snapshot, since, format] {
+                return game_serializer::SerializeStateSince(*snapshot, since, state_coord_decimals_, format);
+            });
+        } else {
+            body = std::make_shared<const std::string>(game_serializer::SerializeStateSince(*snapshot, since, state_coord_decimals_, format));
+        }
+        sendSharedResponseToAuth(std::move(req), std::move(send), std::move(body), format);
     }
     template <typename Body, typename Allocator, typename Send>
-    void handleAction(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
-        if (req.find("Authorization")==req.end()) {
-            send(missingAuthHeaderToAuth(std::move(req)));
+    void handleGetMetrics(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
+        auto to_json = [](const metrics::LatencyStats& stats) {
+            return json::object{
+                {"count", stats.GetCount()},
+                {"avgUs", stats.GetAverageUs()},
+                {"maxUs", stats.GetMaxUs()}
+            };
+        };
+        json::object response{
+            {"tick", to_json(tick_latency_)},
+            {"stateRead", to_json(state_read_latency_)}
+        };
+        sendResponseToAuth(std::move(req), std::move(send), response);
+    }
+    template <typename Body, typename Allocator, typename Send>
+    void handleAction(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, model::Player& player) {
+        json::error_code ec;
+        auto json_body = json::parse(req.body(),ec);
+        if (ec) {
+            send(badParse(std::move(req)));
             return;
         }
-        auto auth_header = req["Authorization"];
-        const std::string bearer_prefix = "Bearer ";
-        if (auth_header.size() <= bearer_prefix.size() ||
-            auth_header.substr(0, bearer_prefix.size()) != bearer_prefix) 
-        {
-            send(invalidAuthHeaderToAuth(std::move(req)));
+        const auto* action = json_body.if_object();
+        const auto* move = action ? action->if_contains("move") : nullptr;
+        if (!move || !move->is_string() || !isValidMove(move->as_string())) {
+            send(badAction(std::move(req)));
             return;
         }
-        std::string token_str = std::string(auth_header.substr(bearer_prefix.size()));
-        if (token_str.empty() || token_str.size() != 32) {
-            send(invalidAuthHeaderToAuth(std::move(req)));
+        applyMove(player, move->as_string());
+        auto session = player.GetSession();
+        scheduleDogMotion(session, player.GetDog()->GetId());
+        // strand выполняет обработчики по порядку, поэтому ответ уходит уже после
+        // публикации снимка с новой скоростью, и следующий /game/state её покажет
+        boost::asio::post(getSessionStrand(*session), [this, req = std::move(req), send = std::move(send)]() mutable {
+            try {
+                json::object response;
+                sendResponseToAuth(std::move(req), std::move(send), response);
+            } catch (std::exception& e) {
+                std::cerr << "Error handling request: " << e.what() << std::endl;
+                if (send) {
+                    send(serverError(std::move(req)));
+                }
+            }
+        });
+    }
+
+    // Отмечает изменение скорости пса и, если публикация ещё не запланирована, ставит её
+    // в очередь strand'а сессии. Так все действия, выполненные до неё, попадают в один
+    // снимок, а не копируют снимок каждое. Вызывается в strand'е сессии
+    void scheduleDogMotion(const std::shared_ptr<model::GameSession>& session, const model::Dog::Id& dog_id) {
+        if (session->MarkDogMotion(dog_id)) {
+            boost::asio::post(getSessionStrand(*session), [session] {
+                session->PublishDogMotion();
+            });
+        }
+    }
+
+    static bool isValidMove(std::string_view move) {
+        return move.empty() || move == "L" || move == "R" || move == "U" || move == "D";
+    }
+
+    // Меняет направление и скорость пса игрока. Вызывается в strand'е его сессии.
+    // Неизвестные команды игнорируются
+    static void applyMove(model::Player& player, std::string_view move_key) {
+        auto& dog = *player.GetDog();
+        const auto map_speed = player.GetSession()->GetMap().GetSpeed();
+        if (move_key == "L") {
+            dog.SetDirection(model::Direction::WEST);
+            dog.SetSpeed(model::Speed(-map_speed.vx, 0));
+        } else if (move_key == "R") {
+            dog.SetDirection(model::Direction::EAST);
+            dog.SetSpeed(model::Speed(map_speed.vx, 0));
+        } else if (move_key == "U") {
+            dog.SetDirection(model::Direction::NORTH);
+            dog.SetSpeed(model::Speed(0, -map_speed.vy));
+        } else if (move_key == "D") {
+            dog.SetDirection(model::Direction::SOUTH);
+            dog.SetSpeed(model::Speed(0, map_speed.vy));
+        } else if (move_key.empty()) {
+            dog.SetSpeed(model::Speed(0, 0));
+        }
+    }
+
+    // Пакет действий: POST /api/v1/game/player/actions с телом [{"token": "<токен>", "move": "L"}, ...].
+    // У действий без token игрок берётся из заголовка Authorization, так что один игрок
+    // может прислать последовательность ходов. Все токены проверяются до применения,
+    // поэтому пакет применяется целиком или не применяется вовсе. Действия одной сессии
+    // выполняются за один заход в её strand в порядке следования в пакете,
+    // ответ отправляется один, когда применены действия во всех сессиях
+    template <typename Body, typename Allocator, typename Send>
+    void handleActionBatch(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
+        json::error_code ec;
+        auto json_body = json::parse(req.body(), ec);
+        if (ec) {
+            send(badParse(std::move(req)));
             return;
         }
-            Token token{token_str};
-            auto player_ = players_.findPlayerByToken(token);
-            if (!player_) {
-                send(badToken(std::move(req)));
+        if (!json_body.is_array() || json_body.as_array().size() > MAX_BATCH_ACTIONS) {
+            send(badActionBatch(std::move(req)));
+            return;
+        }
+        struct Action {
+            model::Players::PlayerPointer player;
+            std::string move;
+        };
+        // Действия, сгруппированные по сессиям; сессий немного — по одной на карту
+        std::vector<std::pair<std::shared_ptr<model::GameSession>, std::vector<Action>>> batches;
+        model::Players::PlayerPointer header_player;
+        for (const auto& item : json_body.as_array()) {
+            const auto* action = item.if_object();
+            const auto* move = action ? action->if_contains("move") : nullptr;
+            if (!move || !move->is_string() || !isValidMove(move->as_string())) {
+                send(badActionBatch(std::move(req)));
                 return;
-            } else {
-                json::error_code ec;
-                auto json_body = json::parse(req.body(),ec);
-                if (ec) {
-                    send(badParse(std::move(req)));
+            }
+            model::Players::PlayerPointer player;
+            if (const auto* token = action->if_contains("token")) {
+                const auto key = token->is_string() ? model::ParseTokenKey(token->as_string()) : std::nullopt;
+                player = key ? players_.findPlayerByToken(*key) : nullptr;
+                if (!player) {
+                    send(badToken(std::move(req)));
                     return;
                 }
-                std::string move_key = std::string(json_body.at("move").as_string());
-                //std::cout<<"dog id1: " << *(player_->GetDog().get()->GetId()) << std::endl;
-                 if (move_key=="L") {
-                    player_->get()->GetDog().get()->SetDirection(model::Direction::WEST);
-                    player_->get()->GetDog().get()->SetSpeed(model::Speed(-(player_->get()->GetSession().get()->GetMap().GetSpeed().vx),0));
-                } else if (move_key=="R") {
-                    player_->get()->GetDog().get()->SetDirection(model::Direction::EAST);
-                    player_->get()->GetDog().get()->SetSpeed(model::Speed(player_->get()->GetSession().get()->GetMap().GetSpeed().vx, 0));
-                } else if (move_key=="U") {
-                    player_->get()->GetDog().get()->SetDirection(model::Direction::NORTH);
-                    player_->get()->GetDog().get()->SetSpeed(model::Speed(0,-(player_->get()->GetSession().get()->GetMap().GetSpeed().vy)));
-                } else if (move_key=="D") {
-                    // std::cout<<"dog dir1: " << player_->GetDog().get()->GetDirection() << std::endl;
-                    // std::cout<<"dog speed1" << player_->GetDog().get()->GetSpeed().vx <<" " << player_->GetDog().get()->GetSpeed().vy << std::endl;
-                    player_->get()->GetDog().get()->SetDirection(model::Direction::SOUTH);
-                    player_->get()->GetDog().get()->SetSpeed(model::Speed(0,player_->get()->GetSession().get()->GetMap().GetSpeed().vy));
-                    // std::cout<<"dog dir2: " << player_->GetDog().get()->GetDirection() << std::endl;
-                    // std::cout<<"dog speed2" << player_->GetDog().get()->GetSpeed().vx <<" " << player_->GetDog().get()->GetSpeed().vy << std::endl;
-                } else if (move_key.empty()){
-                    player_->get()->GetDog().get()->SetSpeed(model::Speed(0,0));
+            } else {
+                if (!header_player && !(header_player = authorizePlayer(req, send))) {
+                    return;
                 }
-                json::object response;
-                sendResponseToAuth(std::move(req), std::move(send), response); 
+                player = header_player;
             }
-    }
-
-    void UpdateCoords(double time_delta, model::Game::GameSessions& session) {
-        for (auto& session : game_.GetGameSessions()) {
-            for (auto& dog_ : session.get()->GetDogs()) {
-                auto dog = dog_.get();
-                auto cur_road = dog->GetCurrentRoad(session.get()->GetMap().GetRoads(),dog->GetCoordinate());
-                if (dog->GetDirectionENUM() == model::Direction::NORTH || dog->GetDirectionENUM() == model::Direction::SOUTH) {
-                    model::Coordinate new_coord = {dog->GetCoordinate().x, dog->GetCoordinate().y + time_delta * dog->GetSpeed().vy};
-                    if (cur_road->IsHorizontal()){
-                        auto new_vertical_road_up =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {static_cast<double>(dog->GetCoordinate().x), static_cast<double>(cur_road->GetStart().y+1)});
-                        auto new_vertical_road_down =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), { static_cast<double>(dog->GetCoordinate().x), static_cast<double>(cur_road->GetStart().y-1)});
-                        if (!(new_coord.y <= cur_road->GetStart().y + 0.4)){
-                            if (new_vertical_road_up == nullptr){
-                                dog->SetCoordinateY(cur_road->GetStart().y + 0.4);
-                                dog->SetSpeed({0,0});
-                            }
-
-                            while (!(new_vertical_road_up == nullptr)) {
-                                double max_coord =std::max(new_vertical_road_up->GetStart().y,new_vertical_road_up->GetEnd().y);
-                                if(new_coord.y >= max_coord+0.4){
-                                    dog->SetCoordinateY(max_coord+0.4);
-                                    dog->SetSpeed({0,0});
-                                    auto new_vertical_road_up =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {dog->GetCoordinate().x, max_coord+1});
-                                } else {
-                                    //dog.SetSpeed(dog_speed_for_new_coord);
-                                    dog->SetCoordinateY(new_coord.y);
-                                    break;
-                                }
-                            } 
-                            /* ТАК БЫЛО После того как сделался while и у нас была дорога  на которую перешли, то мы меняем координату, 
-                            но когда мы рассчитываем новую дорогу у нас цикл заканчивается и начинается проверка, которая срабатывает*/
-                            
-                        } else if (!(new_coord.y >= cur_road->GetStart().y - 0.4)) {
-                            if (new_vertical_road_down == nullptr){
-                                dog->SetCoordinateY(cur_road->GetStart().y - 0.4);
-                                dog->SetSpeed({0,0});
-                            }
-
-                            while (!(new_vertical_road_down == nullptr)) {
-                                double min_coord =std::min(new_vertical_road_down->GetStart().y,new_vertical_road_down->GetEnd().y);
-                                if (new_coord.y <= min_coord - 0.4) {
-                                    dog->SetCoordinateY(min_coord-0.4);
-                                    dog->SetSpeed({0,0});
-                                    auto new_vertical_road_down =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {dog->GetCoordinate().x, min_coord-1});
-                                } else {
-                                    //dog.SetSpeed(dog_speed_for_new_coord);
-                                    dog->SetCoordinateY(new_coord.y);
-                                    break;
-                                }
-                            }
-                            
-                        } else {
-                            //dog.SetSpeed(model::Speed(session.GetMap().GetSpeed().vx, session.GetMap().GetSpeed().vy));
-                            dog->SetCoordinateY(new_coord.y);
-                        }
-                    } else if (cur_road->IsVertical()){
-                        double max_coord_cur_y =std::max(cur_road->GetStart().y,cur_road->GetEnd().y); 
-                        double min_coord_cur_y =std::min(cur_road->GetStart().y,cur_road->GetEnd().y); 
-                        auto new_vertical_road_up =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {dog->GetCoordinate().x, max_coord_cur_y+1});
-                        auto new_vertical_road_down =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {dog->GetCoordinate().x, min_coord_cur_y-1});
-                        if(!(new_coord.y <= max_coord_cur_y+0.4)){
-                            if (new_vertical_road_up == nullptr){
-                                dog->SetCoordinateY(max_coord_cur_y + 0.4);
-                                dog->SetSpeed({0,0});
-                            }
-
-                            while (!(new_vertical_road_up == nullptr)) {
-                                double max_coord_new_y =std::max(new_vertical_road_up->GetStart().y,new_vertical_road_up->GetEnd().y);
-                                if (new_coord.y >= max_coord_new_y+0.4) {
-                                    dog->SetCoordinateY(max_coord_new_y+0.4);
-                                    dog->SetSpeed({0,0});
-                                    auto new_vertical_road_up =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {dog->GetCoordinate().x, max_coord_new_y+1});
-                                } else {
-                                    //dog.SetSpeed(dog_speed_for_new_coord);
-                                    dog->SetCoordinateY(new_coord.y);
-                                    break;
-                                }
-                            } 
-                            
-                        } else if(!(new_coord.y >= min_coord_cur_y-0.4)){
-                            if (new_vertical_road_down == nullptr) {
-                                dog->SetCoordinateY(min_coord_cur_y - 0.4);
-                                dog->SetSpeed({0,0});
-                            }
-
-                            while (!(new_vertical_road_down == nullptr)) {
-                                double min_coord_new_y =std::min(new_vertical_road_down->GetStart().y,new_vertical_road_down->GetEnd().y);
-                                if (new_coord.y <= min_coord_new_y - 0.4) {
-                                    dog->SetCoordinateY(min_coord_new_y-0.4);
-                                    dog->SetSpeed({0,0});
-                                    auto new_vertical_road_down =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {dog->GetCoordinate().x, min_coord_new_y-1});
-                                } else {
-                                    //dog.SetSpeed(dog_speed_for_new_coord);
-                                    dog->SetCoordinateY(new_coord.y);
-                                    break;
-                                }
-                            } 
-                            
-                        } else{
-                            //dog.SetSpeed(dog_speed_for_new_coord);
-                            dog->SetCoordinateY(new_coord.y);
-                        }
+            auto session = player->GetSession();
+            auto batch = std::find_if(batches.begin(), batches.end(), [&session](const auto& batch) {
+                return batch.first == session;
+            });
+            if (batch == batches.end()) {
+                batch = batches.emplace(batches.end(), std::move(session), std::vector<Action>{});
+            }
+            batch->second.push_back({std::move(player), std::string(move->as_string())});
+        }
+        // Если хотя бы в одной сессии действия применить не удалось, клиент получает ошибку
+        auto respond = [this, req = std::move(req), send = std::move(send)](bool failed) mutable {
+            if (failed) {
+                send(serverError(std::move(req)));
+                return;
+            }
+            json::object response;
+            sendResponseToAuth(std::move(req), std::move(send), response);
+        };
+        if (batches.empty()) {
+            respond(false);
+            return;
+        }
+        auto remaining = std::make_shared<std::atomic<size_t>>(batches.size());
+        auto failed = std::make_shared<std::atomic<bool>>(false);
+        auto done = std::make_shared<decltype(respond)>(std::move(respond));
+        for (auto& [session, actions] : batches) {
+            auto& strand = getSessionStrand(*session);
+            boost::asio::dispatch(strand, [this, &strand, session = std::move(session), actions = std::move(actions), remaining, failed, done] {
+                try {
+                    for (const auto& action : actions) {
+                        applyMove(*action.player, action.move);
+                        scheduleDogMotion(session, action.player->GetDog()->GetId());
                     }
-                } else if (dog->GetDirectionENUM() == model::Direction::EAST || dog->GetDirectionENUM() == model::Direction::WEST) {
-                    //Поменять ОБРАЩЕНИЕ К СКОРОСТИ
-                    model::Coordinate new_coord = {dog->GetCoordinate().x + time_delta * dog->GetSpeed().vx, dog->GetCoordinate().y};
-                    if (cur_road->IsVertical()) { 
-                        auto new_horizontal_road_right =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), { static_cast<double>(cur_road->GetStart().x+1), static_cast<double>(dog->GetCoordinate().y)});
-                        auto new_horizontal_road_left =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), { static_cast<double>(cur_road->GetStart().x-1), static_cast<double>(dog->GetCoordinate().y) });
-                        if (!(new_coord.x <= cur_road->GetStart().x + 0.4)){
-                            if (new_horizontal_road_right == nullptr)  {
-                                dog->SetCoordinateX(cur_road->GetStart().x + 0.4);
-                                dog->SetSpeed({0,0});
-                            }
-
-                            while (!(new_horizontal_road_right == nullptr)) {
-                                double max_coord_right_x =std::max(new_horizontal_road_right->GetStart().x,new_horizontal_road_right->GetEnd().x);
-                                if(new_coord.x >= max_coord_right_x+0.4){
-                                    dog->SetCoordinateX(max_coord_right_x+0.4);
-                                    dog->SetSpeed({0,0});
-                                    auto new_horizontal_road_right =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {max_coord_right_x+1, dog->GetCoordinate().y});
-                                } else {
-                                    //dog.SetSpeed(dog_speed_for_new_coord);
-                                    dog->SetCoordinateX(new_coord.x);
-                                    break;
-                                }
-                            } 
-                            
-                        } else if (!(new_coord.x >= cur_road->GetStart().x - 0.4)) {
-                            if (new_horizontal_road_left == nullptr) {
-                                dog->SetCoordinateX(cur_road->GetStart().x - 0.4);
-                                dog->SetSpeed({0,0});
-                            }
-
-                            while (!(new_horizontal_road_left == nullptr)) {
-                                double min_coord_left_x =std::min(new_horizontal_road_left->GetStart().x,new_horizontal_road_left->GetEnd().x);
-                                if (new_coord.x <= min_coord_left_x - 0.4) {
-                                    dog->SetCoordinateX(min_coord_left_x-0.4);
-                                    dog->SetSpeed({0,0});
-                                    auto new_horizontal_road_left =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {min_coord_left_x-1, dog->GetCoordinate().y });
-                                } else {
-                                    //dog.SetSpeed(dog_speed_for_new_coord);
-                                    dog->SetCoordinateX(new_coord.x);
-                                    break;
-                                }
-                            }
-                            
-                        } else {
-                            //dog.SetSpeed(dog_speed_for_new_coord);
-                            dog->SetCoordinateX(new_coord.x);
-                        }
-                    } else if (cur_road->IsHorizontal()){
-                        double max_coord_cur_x =std::max(cur_road->GetStart().x,cur_road->GetEnd().x); 
-                        double min_coord_cur_x =std::min(cur_road->GetStart().x,cur_road->GetEnd().x); 
-                        auto new_horizontal_road_right =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {max_coord_cur_x+1, dog->GetCoordinate().y});
-                        auto new_horizontal_road_left =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {min_coord_cur_x-1, dog->GetCoordinate().y});
-                        if(!(new_coord.x <= max_coord_cur_x+0.4)){
-                            if (new_horizontal_road_right == nullptr) {
-                                dog->SetCoordinateX(max_coord_cur_x + 0.4);
-                                dog->SetSpeed({0,0});
-                            }
-                            if (!(new_horizontal_road_right == nullptr)) {
-                                double max_coord_new_x =std::max(new_horizontal_road_right->GetStart().x,new_horizontal_road_right->GetEnd().x);
-                                if (new_coord.x >= max_coord_new_x+0.4) {
-                                    dog->SetCoordinateX(max_coord_new_x+0.4);
-                                    dog->SetSpeed({0,0});
-                                    auto new_horizontal_road_right =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {max_coord_new_x+1, dog->GetCoordinate().y});
-                                } else {
-                                    //dog.SetSpeed(dog_speed_for_new_coord);
-                                    dog->SetCoordinateX(new_coord.x);
-                                    break;
-                                }
-                            } 
-                            
-                        } else if(!(new_coord.x >= min_coord_cur_x-0.4)){
-                            if (new_horizontal_road_left == nullptr) {
-                                dog->SetCoordinateX(min_coord_cur_x - 0.4);
-                                dog->SetSpeed({0,0});
-                            }
-                            
-                            while (!(new_horizontal_road_left == nullptr)) {
-                                double min_coord_new_x =std::min(new_horizontal_road_left->GetStart().x,new_horizontal_road_left->GetEnd().x);
-                                if (new_coord.x <= min_coord_new_x - 0.4) {
-                                    dog->SetCoordinateX(min_coord_new_x-0.4);
-                                    dog->SetSpeed({0,0});
-                                    auto new_horizontal_road_left =dog->GetCurrentRoad(session.get()->GetMap().GetRoads(), {min_coord_new_x-1, dog->GetCoordinate().y});
-                                } else {
-                                    //dog.SetSpeed(dog_speed_for_new_coord);
-                                    dog->SetCoordinateX(new_coord.x);
-                                    break;
-                                }
-                            } 
-                            
-                        } else{
-                            //dog.SetSpeed(dog_speed_for_new_coord);
-                            dog->SetCoordinateX(new_coord.x);
-                        }
+                } catch (std::exception& e) {
+                    std::cerr << "Error handling request: " << e.what() << std::endl;
+                    failed->store(true, std::memory_order_relaxed);
+                }
+                // Как и для одиночного действия, сессия считается обработанной после публикации снимка
+                boost::asio::post(strand, [remaining, failed, done] {
+                    if (remaining->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        (*done)(failed->load(std::memory_order_relaxed));
                     }
+                });
+            });
+        }
+    }
+
+    // Каждая сессия тикает в своём strand'е, поэтому сессии обновляются параллельно
+    // на потоках io_context, а обработчики API видят состояние сессии либо до тика,
+    // либо после него. on_done вызывается после того, как обновится последняя сессия
+    template <typename Handler>
+    void UpdateCoords(double time_delta, const model::Game::GameSessions& sessions, Handler&& on_done) {
+        if (sessions.empty()) {
+            on_done();
+            return;
+        }
+        auto remaining = std::make_shared<std::atomic<size_t>>(sessions.size());
+        auto done = std::make_shared<std::decay_t<Handler>>(std::forward<Handler>(on_done));
+        for (const auto& session : sessions) {
+            boost::asio::post(getSessionStrand(*session), [this, session, time_delta, remaining, done] {
+                {
+                    metrics::ScopedTimer timer{tick_latency_};
+                    session.get()->Tick(time_delta);
+                    session.get()->PublishSnapshot();
                 }
-            }
+                pushState(*session);
+                if (remaining->fetch_sub(1) == 1) {
+                    (*done)();
+                }
+            });
         }
     }
 
@@ -678,30 +1004,22 @@ private:
         }
         auto time_delta = (json_body.at("timeDelta").as_int64()) * 0.001;
         std::cout << time_delta << std::endl;
-        UpdateCoords(time_delta, game_.GetGameSessions());
-        json::object response;
-        sendResponseToAuth(std::move(req), std::move(send), response);
+        // Отвечаем, когда обновятся все сессии
+        UpdateCoords(time_delta, game_.GetGameSessions(), [this, req = std::move(req), send = std::move(send)]() mutable {
+            json::object response;
+            sendResponseToAuth(std::move(req), std::move(send), response);
+        });
     }
 
     
     template <typename Body, typename Allocator, typename Send>
-    void handleGetMapById(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
-        std::string target_str = std::string(req.target().substr(std::strlen("/api/v1/maps/")));
-        model::Map::Id map_id{target_str};
-        auto map = game_.FindMap(map_id);
-        if (!map) {
+    void handleGetMapById(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, std::string_view map_id) {
+        auto it = map_responses_.find(map_id);
+        if (it == map_responses_.end()) {
             send(mapNotFound(std::move(req)));
             return;
         }
-
-        json::object map_json{
-            {"id", *(map->GetId())},
-            {"name", map->GetName()},
-            {"roads", toJson(map->GetRoads())},
-            {"buildings", toJson(map->GetBuildings())},
-            {"offices", toJson(map->GetOffices())}};
-
-        sendResponseToAuth(std::move(req), std::move(send), map_json);
+        sendPreparedResponse(std::move(req), std::move(send), it->second);
     }
 
     template <typename Body, typename Allocator, typename Send, typename Json>
@@ -723,6 +1041,21 @@ private:
         send(std::move(res));
     }
 
+    // Отправляет готовое тело ответа из общего буфера без копирования
+    template <typename Body, typename Allocator, typename Send>
+    void sendSharedResponseToAuth(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, std::shared_ptr<const std::string> body,
+                                  game_serializer::Format format = game_serializer::Format::JSON) {
+        http::response<http_server::SharedStringBody, http::basic_fields<Allocator>> res{
+            std::piecewise_construct, std::make_tuple(std::move(body)), std::make_tuple(req.get_allocator())};
+        res.result(http::status::ok);
+        res.version(req.version());
+        res.set(http::field::content_type, game_serializer::ContentType(format));
+        res.set(http::field::cache_control, "no-cache");
+        res.set(http::field::vary, "Accept");
+        res.content_length(http_server::SharedStringBody::size(res.body()));
+        send(std::move(res));
+    }
+
     template <typename Body, typename Allocator>
     http::response<http::string_body> badTickParse(http::request<Body, http::basic_fields<Allocator>>&& req) {
         json::object error_response{
@@ -732,6 +1065,33 @@ private:
         return createErrorResponseToAuth(std::move(req), http::status::bad_request, error_response);
     }
 
+    template <typename Body, typename Allocator>
+    http::response<http::string_body> badAction(http::request<Body, http::basic_fields<Allocator>>&& req) {
+        json::object error_response{
+            {"code", "invalidArgument"},
+            {"message", "Expected an action {\"move\": \"L\"|\"R\"|\"U\"|\"D\"|\"\"}"}};
+
+        return createErrorResponseToAuth(std::move(req), http::status::bad_request, error_response);
+    }
+
+    template <typename Body, typename Allocator>
+    http::response<http::string_body> badActionBatch(http::request<Body, http::basic_fields<Allocator>>&& req) {
+        json::object error_response{
+            {"code", "invalidArgument"},
+            {"message", "Expected an array of at most " + std::to_string(MAX_BATCH_ACTIONS) + " actions {\"token\": <token>, \"move\": \"L\"|\"R\"|\"U\"|\"D\"|\"\"}"}};
+
+        return createErrorResponseToAuth(std::move(req), http::status::bad_request, error_response);
+    }
+
+    template <typename Body, typename Allocator>
+    http::response<http::string_body> badStateQuery(http::request<Body, http::basic_fields<Allocator>>&& req) {
+        json::object error_response{
+            {"code", "invalidArgument"},
+            {"message", "Expected either since=<version> or radius=<distance> query parameter"}};
+
+        return createErrorResponseToAuth(std::move(req), http::status::bad_request, error_response);
+    }
+
     template <typename Body, typename Allocator>
     http::response<http::string_body> mapNotFound(http::request<Body, http::basic_fields<Allocator>>&& req) {
         json::object error_response{
@@ -783,6 +1143,16 @@ private:
         return createErrorResponse(std::move(req), http::status::bad_request, error_response);
     }
 
+    // Ответ на запрос, при обработке которого произошла непредвиденная ошибка
+    template <typename Body, typename Allocator>
+    http::response<http::string_body> serverError(http::request<Body, http::basic_fields<Allocator>>&& req) {
+        json::object error_response{
+            {"code", "internalError"},
+            {"message", "Internal server error"}};
+
+        return createErrorResponseToAuth(std::move(req), http::status::internal_server_error, error_response);
+    }
+
     template <typename Body, typename Allocator>
     http::response<http::string_body> badAuth(http::request<Body, http::basic_fields<Allocator>>&& req) {
         json::object error_response{
@@ -888,11 +1258,34 @@ private:
         return res;
     }
 
+    // Ограничение размера пакета действий, чтобы один запрос не занимал strand надолго
+    static constexpr size_t MAX_BATCH_ACTIONS = 10'000;
+
     model::Players players_;
     model::Game& game_;
     std::string path_;
     bool random_spawn_;
     boost::asio::strand<boost::asio::io_context::executor_type>& strand_;
+    // Число знаков после запятой в координатах ответа /game/state; без значения — полная точность
+    std::optional<int> state_coord_decimals_;
+    std::unordered_map<model::Map::Id, Strand, util::TaggedHasher<model::Map::Id>> session_strands_;
+    // Подписчики на состояние сессий по WebSocket. Таблица заполняется в конструкторе,
+    // а список каждой карты меняется только в strand'е её сессии
+    std::unordered_map<model::Map::Id, std::vector<std::weak_ptr<http_server::WebSocketSession>>,
+                       util::TaggedHasher<model::Map::Id>> subscribers_;
+    PreparedResponses maps_response_;
+    // Хешер для поиска карты по string_view из пути запроса без создания std::string
+    struct MapIdHasher {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view id) const noexcept {
+            return std::hash<std::string_view>{}(id);
+        }
+    };
+    std::unordered_map<std::string, PreparedResponses, MapIdHasher, std::equal_to<>> map_responses_;
+    metrics::LatencyStats tick_latency_;
+    metrics::LatencyStats state_read_latency_;
+    static_content::StaticCache static_files_;
 };
     
 }  // namespace http_handler
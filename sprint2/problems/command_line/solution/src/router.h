@@ -0,0 +1,284 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+namespace router {
+
+// Маршрут: шаблон пути вида /api/v1/maps/{id} и связанное с ним значение.
+// Сегмент в фигурных скобках — параметр, он совпадает с любым непустым сегментом пути
+template <typename Value>
+struct Route {
+    std::string_view pattern;
+    Value value;
+};
+
+// Сколько параметров может быть в одном маршруте
+inline constexpr size_t MAX_PARAMS = 4;
+
+namespace detail {
+
+inline constexpr size_t NONE = static_cast<size_t>(-1);
+
+constexpr bool IsParam(std::string_view segment) noexcept {
+    return segment.size() >= 2 && segment.front() == '{' && segment.back() == '}';
+}
+
+// Вызывает fn для каждого сегмента пути: у "/a/b" сегменты "a" и "b", у "/" сегментов нет.
+// Пустые сегменты ("/a//b", "/a/") тоже передаются в fn
+template <typename Fn>
+constexpr void ForEachSegment(std::string_view path, Fn&& fn) {
+    path.remove_prefix(1);
+    if (path.empty()) {
+        return;
+    }
+    for (;;) {
+        const size_t slash = path.find('/');
+        fn(path.substr(0, slash));
+        if (slash == std::string_view::npos) {
+            return;
+        }
+        path.remove_prefix(slash + 1);
+    }
+}
+
+// Дешёвый хеш пути для таблицы маршрутов без параметров: длина и несколько символов с конца
+// и из середины. Коллизии разрешаются сравнением путей целиком
+constexpr size_t HashPath(std::string_view path) noexcept {
+    const size_t size = path.size();
+    return size * 0x9E3779B1u ^ static_cast<unsigned char>(path[size - 1]) * 0x85EBCA77u
+           ^ static_cast<unsigned char>(path[size / 2]) * 0xC2B2AE3Du ^ static_cast<unsigned char>(path[size * 3 / 4]);
+}
+
+}  // namespace detail
+
+// Сколько узлов понадобится дереву для набора маршрутов: корень и не больше узла на сегмент
+template <typename Routes>
+constexpr size_t CountNodes(const Routes& routes) {
+    size_t count = 1;
+    for (const auto& route : routes) {
+        detail::ForEachSegment(route.pattern, [&count](std::string_view) {
+            ++count;
+        });
+    }
+    return count;
+}
+
+/**
+ * Дерево маршрутов по сегментам пути. Строится при компиляции (constexpr), поэтому ошибка
+ * в таблице маршрутов — повторяющийся маршрут или пустой сегмент — не даёт программе собраться.
+ * Маршрут без параметров находится по всему пути в хеш-таблице за одно сравнение строк.
+ * Для остальных поиск идёт по сегментам: дочерние узлы-литералы лежат подряд и отсортированы,
+ * так что стоимость зависит от глубины пути, а не от числа маршрутов.
+ * Литерал имеет приоритет перед параметром; если литеральная ветвь дальше не совпала,
+ * к параметру поиск не возвращается.
+ */
+template <typename Value, size_t NodeCount>
+class Router {
+public:
+    struct Match {
+        const Value* value = nullptr;
+        // Значения параметров в порядке их следования в пути. Указывают в исходный путь
+        std::array<std::string_view, MAX_PARAMS> params{};
+        size_t param_count = 0;
+    };
+
+    template <typename Routes>
+    constexpr explicit Router(const Routes& routes) {
+        std::array<Draft, NodeCount> drafts{};
+        size_t draft_count = 1;
+        for (const auto& route : routes) {
+            if (route.pattern.empty() || route.pattern.front() != '/') {
+                throw std::invalid_argument("Route pattern must start with '/'");
+            }
+            size_t current = 0;
+            size_t params = 0;
+            detail::ForEachSegment(route.pattern, [&](std::string_view segment) {
+                if (segment.empty()) {
+                    throw std::invalid_argument("Route pattern has an empty segment");
+                }
+                const bool is_param = detail::IsParam(segment);
+                if (is_param && ++params > MAX_PARAMS) {
+                    throw std::invalid_argument("Too many route parameters");
+                }
+                size_t child = 1;
+                // Параметры на одной позиции — один узел, как бы они ни назывались
+                while (child != draft_count && !(drafts[child].parent == current && drafts[child].is_param == is_param
+                                                 && (is_param || drafts[child].segment == segment))) {
+                    ++child;
+                }
+                if (child == draft_count) {
+                    if (draft_count == NodeCount) {
+                        throw std::length_error("Too many route nodes");
+                    }
+                    Draft& draft = drafts[draft_count++];
+                    draft.segment = segment;
+                    draft.parent = current;
+                    draft.is_param = is_param;
+                }
+                current = child;
+            });
+            if (drafts[current].terminal) {
+                throw std::invalid_argument("Duplicate route");
+            }
+            drafts[current].terminal = true;
+            drafts[current].value = route.value;
+            drafts[current].pattern = route.pattern;
+            drafts[current].is_static = params == 0;
+        }
+        Layout(drafts, draft_count);
+    }
+
+    // Ищет маршрут за один проход по сегментам пути. Путь передаётся без строки запроса
+    constexpr std::optional<Match> Find(std::string_view path) const noexcept {
+        if (path.empty() || path.front() != '/') {
+            return std::nullopt;
+        }
+        // Большинство запросов идёт к маршрутам без параметров: их путь ищется целиком
+        for (size_t slot = detail::HashPath(path) & (STATIC_SLOTS - 1);; slot = (slot + 1) & (STATIC_SLOTS - 1)) {
+            const StaticRoute& route = static_routes_[slot];
+            if (route.node == detail::NONE) {
+                break;
+            }
+            if (route.path == path) {
+                return Match{&nodes_[route.node].value};
+            }
+        }
+        Match match;
+        size_t node = 0;
+        detail::ForEachSegment(path, [&](std::string_view segment) {
+            if (node != detail::NONE) {
+                node = FindChild(node, segment, match);
+            }
+        });
+        if (node == detail::NONE || !nodes_[node].terminal) {
+            return std::nullopt;
+        }
+        match.value = &nodes_[node].value;
+        return match;
+    }
+
+private:
+    // Узел во время построения: дети ещё не собраны вместе
+    struct Draft {
+        std::string_view segment;
+        size_t parent = detail::NONE;
+        bool is_param = false;
+        bool terminal = false;
+        bool is_static = false;
+        std::string_view pattern;
+        Value value{};
+    };
+
+    struct Node {
+        std::string_view segment;
+        // Дети-литералы: nodes_[first_child], ..., nodes_[first_child + child_count - 1]
+        size_t first_child = 0;
+        size_t child_count = 0;
+        size_t param_child = detail::NONE;
+        bool terminal = false;
+        Value value{};
+    };
+
+    // Маршрут без параметров в хеш-таблице с открытой адресацией
+    struct StaticRoute {
+        std::string_view path;
+        size_t node = detail::NONE;
+    };
+
+    // Таблица заполнена не больше чем наполовину, поэтому поиск отсутствующего пути
+    // быстро упирается в пустую ячейку
+    static constexpr size_t STATIC_SLOTS = std::bit_ceil(NodeCount * 2);
+
+    // Раскладывает узлы в порядке обхода в ширину: так дети каждого узла оказываются рядом
+    constexpr void Layout(const std::array<Draft, NodeCount>& drafts, size_t draft_count) {
+        std::array<size_t, NodeCount> order{};
+        size_t placed = 1;
+        for (size_t position = 0; position != placed; ++position) {
+            const size_t draft = order[position];
+            Node& node = nodes_[position];
+            node.segment = drafts[draft].segment;
+            node.terminal = drafts[draft].terminal;
+            node.value = drafts[draft].value;
+            if (drafts[draft].terminal && drafts[draft].is_static) {
+                AddStaticRoute(drafts[draft].pattern, position);
+            }
+            node.first_child = placed;
+            size_t param = detail::NONE;
+            for (size_t child = 1; child != draft_count; ++child) {
+                if (drafts[child].parent != draft) {
+                    continue;
+                }
+                if (drafts[child].is_param) {
+                    param = child;
+                    continue;
+                }
+                // Вставка с сохранением порядка сегментов
+                size_t i = placed++;
+                for (; i != node.first_child && drafts[order[i - 1]].segment > drafts[child].segment; --i) {
+                    order[i] = order[i - 1];
+                }
+                order[i] = child;
+                ++node.child_count;
+            }
+            if (param != detail::NONE) {
+                node.param_child = placed;
+                order[placed++] = param;
+            }
+        }
+    }
+
+    constexpr void AddStaticRoute(std::string_view path, size_t node) {
+        size_t slot = detail::HashPath(path) & (STATIC_SLOTS - 1);
+        while (static_routes_[slot].node != detail::NONE) {
+            slot = (slot + 1) & (STATIC_SLOTS - 1);
+        }
+        static_routes_[slot] = StaticRoute{path, node};
+    }
+
+    static constexpr size_t LINEAR_SEARCH_CHILDREN = 8;
+
+    constexpr size_t FindChild(size_t parent, std::string_view segment, Match& match) const noexcept {
+        const Node& node = nodes_[parent];
+        size_t first = node.first_child;
+        size_t last = node.first_child + node.child_count;
+        if (node.child_count <= LINEAR_SEARCH_CHILDREN) {
+            // У коротких списков сравнение на равенство, которое сначала смотрит на длину,
+            // обходится дешевле двоичного поиска
+            for (; first != last; ++first) {
+                if (nodes_[first].segment == segment) {
+                    return first;
+                }
+            }
+            return MatchParam(node, segment, match);
+        }
+        while (first != last) {
+            const size_t middle = first + (last - first) / 2;
+            if (nodes_[middle].segment < segment) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+        if (first != node.first_child + node.child_count && nodes_[first].segment == segment) {
+            return first;
+        }
+        return MatchParam(node, segment, match);
+    }
+
+    constexpr size_t MatchParam(const Node& node, std::string_view segment, Match& match) const noexcept {
+        if (node.param_child == detail::NONE || segment.empty()) {
+            return detail::NONE;
+        }
+        match.params[match.param_count++] = segment;
+        return node.param_child;
+    }
+
+    std::array<Node, NodeCount> nodes_{};
+    std::array<StaticRoute, STATIC_SLOTS> static_routes_{};
+};
+
+}  // namespace router
@@ -0,0 +1,331 @@
+#include "static_content.h"
+#include "http_header.h"
+
+#include <brotli/encode.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace static_content {
+
+namespace {
+
+using namespace std::literals;
+using http_header::EqualsIgnoreCase;
+
+constexpr std::pair<std::string_view, std::string_view> MIME_TYPES[] = {
+    {".htm"sv, "text/html"sv}, {".html"sv, "text/html"sv},
+    {".css"sv, "text/css"sv},
+    {".txt"sv, "text/plain"sv},
+    {".js"sv, "text/javascript"sv},
+    {".json"sv, "application/json"sv},
+    {".xml"sv, "application/xml"sv},
+    {".png"sv, "image/png"sv},
+    {".jpg"sv, "image/jpeg"sv}, {".jpe"sv, "image/jpeg"sv}, {".jpeg"sv, "image/jpeg"sv},
+    {".gif"sv, "image/gif"sv},
+    {".bmp"sv, "image/bmp"sv},
+    {".ico"sv, "image/vnd.microsoft.icon"sv},
+    {".tiff"sv, "image/tiff"sv}, {".tif"sv, "image/tiff"sv},
+    {".svg"sv, "image/svg+xml"sv}, {".svgz"sv, "image/svg+xml"sv},
+    {".mp3"sv, "audio/mpeg"sv},
+};
+
+constexpr std::string_view DEFAULT_MIME_TYPE = "application/octet-stream"sv;
+
+// Эти форматы уже сжаты, и сжимать их ещё раз — только тратить время при запуске
+constexpr std::string_view COMPRESSED_MIME_TYPES[] = {
+    "image/png"sv, "image/jpeg"sv, "image/gif"sv, "audio/mpeg"sv,
+};
+
+// Меньше этого размера выигрыш от сжатия сопоставим с заголовком Content-Encoding
+constexpr size_t MIN_COMPRESS_SIZE = 256;
+
+// Качество 10 и 11 сжимает статику клиента лишь на 6–9% лучше, но в 7–18 раз дольше,
+// а сжатие выполняется при каждом запуске сервера
+constexpr int BROTLI_QUALITY = 9;
+
+std::string CompressGzip(std::string_view data) {
+    z_stream stream{};
+    // 15 + 16: окно 32 КБ и обёртка gzip вместо zlib
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("Failed to initialize gzip compression");
+    }
+    std::string result(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(result.data());
+    stream.avail_out = static_cast<uInt>(result.size());
+    const int status = deflate(&stream, Z_FINISH);
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        throw std::runtime_error("gzip compression failed");
+    }
+    return result;
+}
+
+std::string CompressBrotli(std::string_view data) {
+    size_t size = BrotliEncoderMaxCompressedSize(data.size());
+    std::string result(size, '\0');
+    if (!BrotliEncoderCompress(BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC, data.size(),
+                               reinterpret_cast<const uint8_t*>(data.data()), &size,
+                               reinterpret_cast<uint8_t*>(result.data()))) {
+        throw std::runtime_error("brotli compression failed");
+    }
+    result.resize(size);
+    return result;
+}
+
+constexpr std::string_view MONTHS[] = {
+    "Jan"sv, "Feb"sv, "Mar"sv, "Apr"sv, "May"sv, "Jun"sv, "Jul"sv, "Aug"sv, "Sep"sv, "Oct"sv, "Nov"sv, "Dec"sv,
+};
+
+std::time_t ToTimeT(fs::file_time_type time) {
+    const auto system_time = std::chrono::file_clock::to_sys(time);
+    return std::chrono::system_clock::to_time_t(
+        std::chrono::time_point_cast<std::chrono::system_clock::duration>(system_time));
+}
+
+// Дата в формате заголовка Last-Modified: "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string FormatHttpDate(std::time_t seconds) {
+    std::tm tm{};
+    gmtime_r(&seconds, &tm);
+    char buffer[32];
+    const size_t size = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buffer, size);
+}
+
+Variant MakeVariant(std::string data) {
+    std::string etag = MakeStrongEtag(data);
+    return {std::make_shared<const std::string>(std::move(data)), std::move(etag)};
+}
+
+StaticFile LoadFile(const fs::path& path, uintmax_t size, fs::file_time_type last_write_time) {
+    std::string data(size, '\0');
+    std::ifstream input(path, std::ios::binary);
+    if (!input.read(data.data(), static_cast<std::streamsize>(size))) {
+        throw std::runtime_error("Failed to read " + path.string());
+    }
+
+    StaticFile file;
+    file.content_type = GetMimeType(path.extension().string());
+    file.modified_at = ToTimeT(last_write_time);
+    file.last_modified = FormatHttpDate(file.modified_at);
+    const bool compressible = data.size() >= MIN_COMPRESS_SIZE
+        && std::find(std::begin(COMPRESSED_MIME_TYPES), std::end(COMPRESSED_MIME_TYPES), file.content_type)
+               == std::end(COMPRESSED_MIME_TYPES);
+    if (compressible) {
+        for (Encoding encoding : {Encoding::GZIP, Encoding::BROTLI}) {
+            // Вариант, который меньше исходного не хотя бы на десятую часть, не хранится
+            if (std::string compressed = Compress(data, encoding); compressed.size() * 10 < data.size() * 9) {
+                file.variants[static_cast<size_t>(encoding)] = MakeVariant(std::move(compressed));
+            }
+        }
+    }
+    file.variants[static_cast<size_t>(Encoding::IDENTITY)] = MakeVariant(std::move(data));
+    return file;
+}
+
+}  // namespace
+
+std::string_view ContentEncoding(Encoding encoding) noexcept {
+    switch (encoding) {
+        case Encoding::GZIP:
+            return "gzip"sv;
+        case Encoding::BROTLI:
+            return "br"sv;
+        case Encoding::IDENTITY:
+            break;
+    }
+    return {};
+}
+
+std::string MakeStrongEtag(std::string_view data) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : data) {
+        hash = (hash ^ c) * 0x100000001b3ull;
+    }
+    static constexpr char HEX_CHARS[] = "0123456789abcdef";
+    std::string etag(18, '"');
+    for (int i = 0; i < 16; ++i) {
+        etag[16 - i] = HEX_CHARS[(hash >> (i * 4)) & 0xF];
+    }
+    return etag;
+}
+
+std::string_view GetMimeType(std::string_view extension) {
+    for (const auto& [ext, mime_type] : MIME_TYPES) {
+        if (EqualsIgnoreCase(ext, extension)) {
+            return mime_type;
+        }
+    }
+    return DEFAULT_MIME_TYPE;
+}
+
+std::string Compress(std::string_view data, Encoding encoding) {
+    switch (encoding) {
+        case Encoding::GZIP:
+            return CompressGzip(data);
+        case Encoding::BROTLI:
+            return CompressBrotli(data);
+        case Encoding::IDENTITY:
+            break;
+    }
+    return std::string(data);
+}
+
+std::optional<std::time_t> ParseHttpDate(std::string_view date) {
+    std::string_view s = http_header::Trim(date);
+    const auto expect = [&s](std::string_view token) {
+        if (!s.starts_with(token)) {
+            return false;
+        }
+        s.remove_prefix(token.size());
+        return true;
+    };
+    const auto read_number = [&s](size_t digits, int& value) {
+        if (s.size() < digits) {
+            return false;
+        }
+        value = 0;
+        for (size_t i = 0; i < digits; ++i) {
+            if (s[i] < '0' || s[i] > '9') {
+                return false;
+            }
+            value = value * 10 + (s[i] - '0');
+        }
+        s.remove_prefix(digits);
+        return true;
+    };
+    const auto read_month = [&s](int& month) {
+        const auto it = std::find(std::begin(MONTHS), std::end(MONTHS), s.substr(0, 3));
+        if (it == std::end(MONTHS)) {
+            return false;
+        }
+        month = static_cast<int>(it - std::begin(MONTHS));
+        s.remove_prefix(3);
+        return true;
+    };
+
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    const auto read_time = [&] {
+        return read_number(2, hour) && expect(":"sv) && read_number(2, minute) && expect(":"sv) && read_number(2, second);
+    };
+    const size_t comma = s.find(',');
+    bool parsed = false;
+    if (comma == 3) {
+        // IMF-fixdate: "Sun, 06 Nov 1994 08:49:37 GMT"
+        s.remove_prefix(comma + 1);
+        parsed = expect(" "sv) && read_number(2, day) && expect(" "sv) && read_month(month) && expect(" "sv)
+            && read_number(4, year) && expect(" "sv) && read_time() && expect(" GMT"sv);
+    } else if (comma != std::string_view::npos) {
+        // RFC 850: "Sunday, 06-Nov-94 08:49:37 GMT". Двузначный год ближе к 1970, чем к 2070
+        s.remove_prefix(comma + 1);
+        parsed = expect(" "sv) && read_number(2, day) && expect("-"sv) && read_month(month) && expect("-"sv)
+            && read_number(2, year) && expect(" "sv) && read_time() && expect(" GMT"sv);
+        year += year < 70 ? 2000 : 1900;
+    } else if (s.size() > 3) {
+        // asctime: "Sun Nov  6 08:49:37 1994"
+        s.remove_prefix(3);
+        parsed = expect(" "sv) && read_month(month) && expect(" "sv)
+            && (expect(" "sv) ? read_number(1, day) : read_number(2, day)) && expect(" "sv)
+            && read_time() && expect(" "sv) && read_number(4, year);
+    }
+    if (!parsed || !s.empty() || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+        return std::nullopt;
+    }
+    std::tm tm{};
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = second;
+    return timegm(&tm);
+}
+
+Encoding ChooseEncoding(std::string_view accept_encoding, const StaticFile& file) {
+    if (!file.HasCompressedVariants()) {
+        return Encoding::IDENTITY;
+    }
+    // Вес кодирования, не упомянутого в заголовке, берётся у "*", а без "*" равен нулю.
+    // identity допустимо всегда, если его не запретили явно
+    double brotli = -1;
+    double gzip = -1;
+    double identity = -1;
+    double any = -1;
+    http_header::ForEachWeighted(accept_encoding, [&](std::string_view coding, double q) {
+        if (EqualsIgnoreCase(coding, "br"sv)) {
+            brotli = q;
+        } else if (EqualsIgnoreCase(coding, "gzip"sv) || EqualsIgnoreCase(coding, "x-gzip"sv)) {
+            gzip = q;
+        } else if (EqualsIgnoreCase(coding, "identity"sv)) {
+            identity = q;
+        } else if (coding == "*"sv) {
+            any = q;
+        }
+    });
+    const auto weight = [any, &file](double q, Encoding encoding) {
+        if (!file.GetVariant(encoding).body) {
+            return 0.0;
+        }
+        return q >= 0 ? q : std::max(any, 0.0);
+    };
+
+    Encoding best = Encoding::IDENTITY;
+    double best_weight = identity >= 0 ? identity : 0.0;
+    // Сжатый вариант выигрывает у identity при равном весе
+    for (auto [encoding, q] : {std::pair{Encoding::BROTLI, brotli}, std::pair{Encoding::GZIP, gzip}}) {
+        if (const double w = weight(q, encoding); w > 0 && (w > best_weight || (w == best_weight && best == Encoding::IDENTITY))) {
+            best = encoding;
+            best_weight = w;
+        }
+    }
+    return best;
+}
+
+StaticCache::StaticCache(const fs::path& root) {
+    std::error_code ec;
+    const fs::path canonical_root = fs::canonical(root, ec);
+    if (ec || !fs::is_directory(canonical_root, ec)) {
+        return;
+    }
+    for (fs::recursive_directory_iterator it{canonical_root, fs::directory_options::skip_permission_denied, ec}, end;
+         !ec && it != end; it.increment(ec)) {
+        const fs::directory_entry& entry = *it;
+        std::error_code entry_ec;
+        if (!entry.is_regular_file(entry_ec)) {
+            continue;
+        }
+        // Ссылка на файл вне корня в кеш не попадает, как и при чтении файла с диска
+        const fs::path target = fs::canonical(entry.path(), entry_ec);
+        if (entry_ec || std::mismatch(canonical_root.begin(), canonical_root.end(), target.begin(), target.end()).first
+                            != canonical_root.end()) {
+            continue;
+        }
+        const uintmax_t size = fs::file_size(target, entry_ec);
+        const auto last_write_time = fs::last_write_time(target, entry_ec);
+        if (entry_ec || size > MAX_FILE_SIZE) {
+            continue;
+        }
+        try {
+            files_.emplace("/" + entry.path().lexically_relative(canonical_root).generic_string(),
+                           LoadFile(target, size, last_write_time));
+        } catch (const std::exception& e) {
+            std::cerr << "Static file is not cached: " << e.what() << std::endl;
+        }
+    }
+}
+
+const StaticFile* StaticCache::Find(std::string_view path) const {
+    const auto it = files_.find(path);
+    return it == files_.end() ? nullptr : &it->second;
+}
+
+}  // namespace static_content
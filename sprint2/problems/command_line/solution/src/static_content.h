@@ -0,0 +1,105 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace static_content {
+
+namespace fs = std::filesystem;
+
+// Кодирование тела ответа (Content-Encoding). Значение — индекс в StaticFile::variants
+enum class Encoding {
+    IDENTITY,
+    GZIP,
+    BROTLI
+};
+
+inline constexpr size_t ENCODING_COUNT = 3;
+
+// Значение заголовка Content-Encoding; у IDENTITY заголовка нет
+std::string_view ContentEncoding(Encoding encoding) noexcept;
+
+// Строгий ETag: FNV-1a от содержимого, поэтому он не меняется после перезапуска сервера
+std::string MakeStrongEtag(std::string_view data);
+
+// MIME-тип по расширению файла без учёта регистра
+std::string_view GetMimeType(std::string_view extension);
+
+// Сжимает data в gzip (с наибольшей степенью сжатия) или brotli
+std::string Compress(std::string_view data, Encoding encoding);
+
+// Содержимое файла в одном из кодирований и ETag именно этих байт
+struct Variant {
+    std::shared_ptr<const std::string> body;
+    std::string etag;
+};
+
+struct StaticFile {
+    std::string_view content_type;
+    // Время изменения файла с точностью до секунды и оно же в формате Last-Modified
+    std::time_t modified_at = 0;
+    std::string last_modified;
+    // Сжатые варианты есть только у тех файлов, которые от сжатия заметно уменьшаются;
+    // у отсутствующего варианта body == nullptr
+    std::array<Variant, ENCODING_COUNT> variants;
+
+    bool HasCompressedVariants() const noexcept {
+        return variants[static_cast<size_t>(Encoding::GZIP)].body || variants[static_cast<size_t>(Encoding::BROTLI)].body;
+    }
+
+    const Variant& GetVariant(Encoding encoding) const noexcept {
+        return variants[static_cast<size_t>(encoding)];
+    }
+};
+
+// Разбирает дату HTTP (If-Modified-Since) в любом из трёх допустимых форматов:
+// "Sun, 06 Nov 1994 08:49:37 GMT", "Sunday, 06-Nov-94 08:49:37 GMT" и "Sun Nov  6 08:49:37 1994".
+// Возвращает std::nullopt, если строка не является датой
+std::optional<std::time_t> ParseHttpDate(std::string_view date);
+
+// Выбирает вариант файла по заголовку Accept-Encoding: с наибольшим весом q среди
+// доступных, при равных весах — меньший по размеру (brotli, затем gzip)
+Encoding ChooseEncoding(std::string_view accept_encoding, const StaticFile& file);
+
+/**
+ * Статические файлы, прочитанные в память при запуске сервера вместе с заранее
+ * сжатыми вариантами. Ключ — путь файла относительно корня в виде "/js/game.js".
+ * После построения кеш не меняется и читается из любого потока без блокировок.
+ * Файлы больше MAX_FILE_SIZE и файлы, появившиеся после запуска, в кеш не попадают.
+ */
+class StaticCache {
+public:
+    static constexpr uintmax_t MAX_FILE_SIZE = 16 * 1024 * 1024;
+
+    explicit StaticCache(const fs::path& root);
+
+    StaticCache(const StaticCache&) = delete;
+    StaticCache& operator=(const StaticCache&) = delete;
+
+    // path — декодированный путь запроса без строки запроса
+    const StaticFile* Find(std::string_view path) const;
+
+    size_t Size() const noexcept {
+        return files_.size();
+    }
+
+private:
+    struct PathHasher {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view path) const noexcept {
+            return std::hash<std::string_view>{}(path);
+        }
+    };
+
+    std::unordered_map<std::string, StaticFile, PathHasher, std::equal_to<>> files_;
+};
+
+}  // namespace static_content
@@ -0,0 +1,126 @@
+#pragma once
+#include <sys/random.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <system_error>
+
+namespace util {
+
+/**
+ * Генератор случайных чисел, свой у каждого потока.
+ * Удовлетворяет требованиям UniformRandomBitGenerator, поэтому подходит для
+ * стандартных распределений:
+ *
+ *  std::uniform_int_distribution<> dis(0, 9);
+ *  int value = dis(util::ThreadRandom::Get());
+ *
+ * std::random_device (а значит, системный вызов) используется только при создании
+ * генератора и затем раз в RESEED_INTERVAL чисел, а не при каждом обращении.
+ * Синхронизация не нужна: каждый поток работает только со своим экземпляром.
+ *
+ * Выход mt19937_64 предсказуем по нескольким сотням значений, поэтому генератор
+ * годится только для игровой случайности. Для секретов (токенов) есть SecureRandom.
+ */
+class ThreadRandom {
+public:
+    using result_type = std::mt19937_64::result_type;
+
+    static constexpr uint64_t RESEED_INTERVAL = uint64_t{1} << 20;
+
+    static ThreadRandom& Get() {
+        thread_local ThreadRandom instance;
+        return instance;
+    }
+
+    static constexpr result_type min() {
+        return std::mt19937_64::min();
+    }
+    static constexpr result_type max() {
+        return std::mt19937_64::max();
+    }
+
+    result_type operator()() {
+        if (++generated_ == RESEED_INTERVAL) {
+            Reseed();
+        }
+        return engine_();
+    }
+
+    ThreadRandom(const ThreadRandom&) = delete;
+    ThreadRandom& operator=(const ThreadRandom&) = delete;
+
+private:
+    ThreadRandom() {
+        Reseed();
+    }
+
+    void Reseed() {
+        std::random_device random_device;
+        std::seed_seq seed{random_device(), random_device(), random_device(), random_device()};
+        engine_.seed(seed);
+        generated_ = 0;
+    }
+
+    std::mt19937_64 engine_;
+    uint64_t generated_ = 0;
+};
+
+/**
+ * Криптографически стойкие случайные числа из ядра (getrandom), свои у каждого потока.
+ * Байты читаются блоками по BUFFER_SIZE, так что системный вызов приходится
+ * на несколько сотен чисел, а не на каждое. Выданные байты в буфере затираются,
+ * чтобы по памяти процесса нельзя было узнать уже выданные значения.
+ */
+class SecureRandom {
+public:
+    static constexpr size_t BUFFER_SIZE = 4096;
+
+    static SecureRandom& Get() {
+        thread_local SecureRandom instance;
+        return instance;
+    }
+
+    uint64_t Next() {
+        if (position_ == buffer_.size()) {
+            Refill();
+        }
+        uint64_t value;
+        std::memcpy(&value, buffer_.data() + position_, sizeof(value));
+        std::memset(buffer_.data() + position_, 0, sizeof(value));
+        position_ += sizeof(value);
+        return value;
+    }
+
+    SecureRandom(const SecureRandom&) = delete;
+    SecureRandom& operator=(const SecureRandom&) = delete;
+
+private:
+    SecureRandom() = default;
+
+    void Refill() {
+        size_t filled = 0;
+        while (filled < buffer_.size()) {
+            const ssize_t read = getrandom(buffer_.data() + filled, buffer_.size() - filled, 0);
+            if (read < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "getrandom failed");
+            }
+            filled += static_cast<size_t>(read);
+        }
+        position_ = 0;
+    }
+
+    static_assert(BUFFER_SIZE % sizeof(uint64_t) == 0);
+
+    std::array<unsigned char, BUFFER_SIZE> buffer_{};
+    size_t position_ = BUFFER_SIZE;
+};
+
+}  // namespace util
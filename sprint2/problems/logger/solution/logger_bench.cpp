@@ -0,0 +1,61 @@
+// Пропускная способность логера: синхронный режим против асинхронного
+// с политиками BLOCK и DROP при разном числе пишущих потоков
+#include "my_logger.h"
+
+#include <chrono>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+// Возвращает число строк в миллисекунду, включая время дозаписи очереди в файл
+double MeasureLinesPerMs(int threads, int lines_per_thread) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> writers;
+    for (int t = 0; t < threads; ++t) {
+        writers.emplace_back([t, lines_per_thread] {
+            for (int i = 0; i < lines_per_thread; ++i) {
+                LOG("Thread "sv, t, ", logging attempt "sv, i, ". "sv, "I Love it"sv);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    Logger::GetInstance().Flush();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return threads * lines_per_thread / std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+}  // namespace
+
+int main() {
+    constexpr int lines_per_thread = 100'000;
+    const int thread_counts[] = {1, 4, 8};
+    auto& logger = Logger::GetInstance();
+
+    for (int threads : thread_counts) {
+        std::cout << "sync\tthreads: "sv << threads << "\t"sv
+                  << MeasureLinesPerMs(threads, lines_per_thread) << " lines/ms"sv << std::endl;
+    }
+
+    logger.EnableAsync(1 << 16, Logger::OverflowPolicy::BLOCK);
+    for (int threads : thread_counts) {
+        std::cout << "async block\tthreads: "sv << threads << "\t"sv
+                  << MeasureLinesPerMs(threads, lines_per_thread) << " lines/ms"sv << std::endl;
+    }
+    logger.DisableAsync();
+
+    logger.EnableAsync(1 << 16, Logger::OverflowPolicy::DROP);
+    for (int threads : thread_counts) {
+        const uint64_t dropped_before = logger.GetDroppedCount();
+        const double lines_per_ms = MeasureLinesPerMs(threads, lines_per_thread);
+        std::cout << "async drop\tthreads: "sv << threads << "\t"sv << lines_per_ms << " lines/ms"sv
+                  << "\tdropped: "sv << logger.GetDroppedCount() - dropped_before << std::endl;
+    }
+    logger.DisableAsync();
+}
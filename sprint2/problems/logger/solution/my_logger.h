@@ -1,12 +1,14 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
-#include <iomanip>
+#include <ctime>
 #include <fstream>
+#include <limits>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <string_view>
-#include <optional>
 #include <mutex>
 #include <thread>
 #include <iostream>
@@ -15,49 +17,253 @@ using namespace std::literals;
 
 #define LOG(...) Logger::GetInstance().Log(__VA_ARGS__)
 
+// Ограниченная кольцевая очередь для многих писателей и одного читателя.
+// У каждой ячейки свой счётчик, по которому писатель узнаёт, что ячейка свободна,
+// а читатель — что запись в ней закончена. Блокировок нет, писатели
+// конкурируют только за позицию записи
+template <typename T>
+class MpscRing {
+public:
+    // Ёмкость очереди, созданной с capacity: округление вверх до степени двойки
+    static size_t RoundCapacity(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    explicit MpscRing(size_t capacity) {
+        const size_t size = RoundCapacity(capacity);
+        mask_ = size - 1;
+        cells_ = std::make_unique<Cell[]>(size);
+        for (size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Можно вызывать из любого потока. Возвращает false, если очередь заполнена
+    bool TryPush(T&& value) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Вызывается только из потока-читателя
+    bool TryPop(T& value) {
+        Cell& cell = cells_[dequeue_pos_ & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1) {
+            return false;
+        }
+        value = std::move(cell.value);
+        cell.sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_pos_;
+        return true;
+    }
+
+    size_t Capacity() const {
+        return mask_ + 1;
+    }
+
+    // Сколько позиций выдано писателям. Читатель забирает записи в порядке позиций
+    size_t GetPushedCount() const {
+        return enqueue_pos_.load(std::memory_order_acquire);
+    }
+
+    // Вызывается только из потока-читателя
+    bool Empty() const {
+        return cells_[dequeue_pos_ & mask_].sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) size_t dequeue_pos_ = 0;
+};
+
 class Logger {
+public:
+    // Что делать с записью, если очередь асинхронного режима заполнена
+    enum class OverflowPolicy {
+        BLOCK,  // ждать, пока фоновый поток освободит место
+        DROP    // отбросить запись и увеличить счётчик GetDroppedCount
+    };
+
 private:
+    using Clock = std::chrono::system_clock;
+    static constexpr Clock::rep NO_MANUAL_TS = std::numeric_limits<Clock::rep>::min();
+    static constexpr std::time_t SECONDS_PER_DAY = 24 * 60 * 60;
+    // Сколько записей фоновый поток пишет в файл за один раз
+    static constexpr size_t MAX_BATCH = 1024;
+
+    // Запись асинхронного режима: время нужно фоновому потоку, чтобы выбрать файл
+    struct Record {
+        std::time_t time = 0;
+        std::string text;
+    };
+
     std::ofstream log_file_;
-    std::string current_log_file_name_;
+    std::time_t current_log_file_day_ = -1;
     std::mutex mutex_;
-    std::optional<std::chrono::system_clock::time_point> manual_ts_;
+    std::atomic<Clock::rep> manual_ts_{NO_MANUAL_TS};
+
+    std::unique_ptr<MpscRing<Record>> queue_;
+    OverflowPolicy policy_ = OverflowPolicy::BLOCK;
+    std::atomic<bool> async_{false};
+    // Сколько потоков сейчас внутри асинхронной ветки Log. DisableAsync ждёт, пока их не останется,
+    // иначе запись, положенная после последнего прохода фонового потока, потерялась бы
+    std::atomic<size_t> producers_{0};
+    std::atomic<bool> stop_{false};
+    std::atomic<bool> worker_sleeping_{false};
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::thread worker_;
 
     Logger() {
         std::lock_guard<std::mutex> lock(mutex_);
-        OpenLogFile();
+        OpenLogFile(std::chrono::system_clock::to_time_t(GetTime()));
     }
 
     Logger(const Logger&) = delete;
 
-    auto GetTime() const {
-        if (manual_ts_) {
-            return *manual_ts_;
+    ~Logger() {
+        DisableAsync();
+    }
+
+    Clock::time_point GetTime() const {
+        const auto manual_ts = manual_ts_.load(std::memory_order_acquire);
+        if (manual_ts != NO_MANUAL_TS) {
+            return Clock::time_point{Clock::duration{manual_ts}};
         }
-        return std::chrono::system_clock::now();
+        return Clock::now();
     }
 
-    auto GetTimeStamp() const {
-        const auto now = GetTime();
-        const auto t_c = std::chrono::system_clock::to_time_t(now);
-        return std::put_time(std::gmtime(&t_c), "%F %T");
+    // Строка "%F %T" для секунды t. Форматируется заново только при смене секунды,
+    // у каждого потока свой кэш
+    static std::string_view GetTimeStamp(std::time_t t) {
+        thread_local std::time_t cached_time = -1;
+        thread_local char cached_text[32];
+        thread_local size_t cached_size = 0;
+        if (t != cached_time) {
+            std::tm tm{};
+            gmtime_r(&t, &tm);
+            cached_size = std::strftime(cached_text, sizeof(cached_text), "%F %T", &tm);
+            cached_time = t;
+        }
+        return {cached_text, cached_size};
     }
 
-    std::string GetFileTimeStamp() const {
-        const auto now = GetTime();
-        const auto t_c = std::chrono::system_clock::to_time_t(now);
-        std::stringstream ss;
-        ss << std::put_time(std::gmtime(&t_c), "%Y_%m_%d");
-        return ss.str();
+    static std::string GetFileTimeStamp(std::time_t t) {
+        std::tm tm{};
+        gmtime_r(&t, &tm);
+        char text[16];
+        const size_t size = std::strftime(text, sizeof(text), "%Y_%m_%d", &tm);
+        return {text, size};
     }
 
-    void OpenLogFile() {
-        const std::string log_file_name = "/var/log/sample_log_" + GetFileTimeStamp() + ".log";
-        if (log_file_name != current_log_file_name_) {
+    // Вызывается под mutex_. Файл меняется только при смене суток
+    void OpenLogFile(std::time_t t) {
+        const std::time_t day = t / SECONDS_PER_DAY;
+        if (day != current_log_file_day_) {
             if (log_file_.is_open()) {
                 log_file_.close();
             }
-            current_log_file_name_ = log_file_name;
-            log_file_.open(current_log_file_name_, std::ios::app);
+            current_log_file_day_ = day;
+            log_file_.open("/var/log/sample_log_" + GetFileTimeStamp(t) + ".log", std::ios::app);
+        }
+    }
+
+    template<class... Ts>
+    void LogAsync(const Ts&... args) {
+        const std::time_t t = Clock::to_time_t(GetTime());
+        // Форматирование выполняется в потоке, который пишет в лог, фоновому потоку
+        // остаётся только склеить готовые строки и записать их в файл
+        thread_local std::ostringstream stream;
+        stream.str({});
+        stream.clear();
+        stream << GetTimeStamp(t) << ": "sv;
+        (stream << ... << args);
+        stream << '\n';
+        Record record{t, stream.str()};
+
+        while (!queue_->TryPush(std::move(record))) {
+            if (policy_ == OverflowPolicy::DROP) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            WakeWorker();
+            std::this_thread::yield();
+        }
+        WakeWorker();
+    }
+
+    void WakeWorker() {
+        // Пара к барьеру в RunWorker: либо фоновый поток увидит новую запись,
+        // либо мы увидим, что он уснул, и разбудим его
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (worker_sleeping_.load(std::memory_order_relaxed)) {
+            worker_sleeping_.store(false, std::memory_order_relaxed);
+            worker_sleeping_.notify_one();
+        }
+    }
+
+    void RunWorker() {
+        Record record;
+        std::string batch;
+        for (;;) {
+            size_t count = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                while (count < MAX_BATCH && queue_->TryPop(record)) {
+                    if (record.time / SECONDS_PER_DAY != current_log_file_day_) {
+                        log_file_ << batch;
+                        batch.clear();
+                        OpenLogFile(record.time);
+                    }
+                    batch += record.text;
+                    ++count;
+                }
+                if (count != 0) {
+                    log_file_ << batch;
+                    log_file_.flush();
+                    batch.clear();
+                }
+            }
+            if (count != 0) {
+                written_.fetch_add(count, std::memory_order_release);
+                written_.notify_all();
+                continue;
+            }
+            if (stop_.load(std::memory_order_acquire)) {
+                return;
+            }
+            worker_sleeping_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!queue_->Empty() || stop_.load(std::memory_order_acquire)) {
+                worker_sleeping_.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            worker_sleeping_.wait(true);
         }
     }
 
@@ -69,15 +275,81 @@ public:
 
     template<class... Ts>
     void Log(const Ts&... args) {
+        if (async_.load(std::memory_order_acquire)) {
+            // Пара к DisableAsync: либо он увидит этот поток в producers_ и дождётся его,
+            // либо этот поток увидит, что асинхронный режим уже выключен
+            producers_.fetch_add(1, std::memory_order_seq_cst);
+            if (async_.load(std::memory_order_seq_cst)) {
+                LogAsync(args...);
+                producers_.fetch_sub(1, std::memory_order_release);
+                return;
+            }
+            producers_.fetch_sub(1, std::memory_order_release);
+        }
         std::lock_guard<std::mutex> lock(mutex_);
-        OpenLogFile();
-        log_file_ << GetTimeStamp() << ": "sv ;
+        const std::time_t t = Clock::to_time_t(GetTime());
+        OpenLogFile(t);
+        log_file_ << GetTimeStamp(t) << ": "sv ;
         (log_file_ << ... << args);
         log_file_ << std::endl;
     }
 
+    // Переводит логер в асинхронный режим: Log только кладёт готовую строку в очередь
+    // на capacity записей, а в файл их пачками пишет фоновый поток.
+    // Включать до начала логирования из других потоков
+    void EnableAsync(size_t capacity = 1 << 16, OverflowPolicy policy = OverflowPolicy::BLOCK) {
+        if (async_.load(std::memory_order_acquire)) {
+            return;
+        }
+        // Очередь прошлого включения пуста, и если она того же размера, используется снова.
+        // Счётчик written_ продолжает её счётчик позиций
+        if (!queue_ || queue_->Capacity() != MpscRing<Record>::RoundCapacity(capacity)) {
+            queue_ = std::make_unique<MpscRing<Record>>(capacity);
+            written_.store(0, std::memory_order_relaxed);
+        }
+        policy_ = policy;
+        stop_.store(false, std::memory_order_relaxed);
+        worker_ = std::thread([this] {
+            RunWorker();
+        });
+        async_.store(true, std::memory_order_release);
+    }
+
+    // Дописывает всё, что осталось в очереди, и возвращает логер в синхронный режим.
+    // Новые вызовы Log сразу пишут синхронно, а уже начатые асинхронные дописываются:
+    // фоновый поток останавливается только после них, так что и при политике BLOCK
+    // с заполненной очередью им есть кому освободить место.
+    // Очередь не освобождается: Flush из другого потока может ещё обращаться к ней
+    void DisableAsync() {
+        if (!async_.exchange(false, std::memory_order_seq_cst)) {
+            return;
+        }
+        while (producers_.load(std::memory_order_seq_cst) != 0) {
+            std::this_thread::yield();
+        }
+        stop_.store(true, std::memory_order_release);
+        WakeWorker();
+        worker_.join();
+    }
+
+    // Ждёт, пока все записи, поставленные в очередь к этому моменту, окажутся в файле
+    void Flush() {
+        if (!async_.load(std::memory_order_acquire)) {
+            return;
+        }
+        const uint64_t target = queue_->GetPushedCount();
+        for (uint64_t written = written_.load(std::memory_order_acquire); written < target;
+             written = written_.load(std::memory_order_acquire)) {
+            written_.wait(written);
+        }
+    }
+
+    // Сколько записей отброшено из-за переполнения очереди (политика DROP)
+    uint64_t GetDroppedCount() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
     void SetTimestamp(std::chrono::system_clock::time_point ts) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        manual_ts_ = ts;
+        manual_ts_.store(ts.time_since_epoch().count(), std::memory_order_release);
     }
 };